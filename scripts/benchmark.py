@@ -35,9 +35,10 @@ images = [
 
 images = [{ p: i for p, i in zip(params, image) } for image in images] # Convert to dict
 
-def get_timing(image, b, skipmode):
+def get_timing(image, b, skipmode, occupancy=None):
     output = "FAIL"
     try:
+        options = [] if occupancy is None else ["--occupancy={}".format(occupancy)]
         output = subprocess.Popen(
             [app,
              "--width={}".format(width),
@@ -48,8 +49,9 @@ def get_timing(image, b, skipmode):
              "--gmin={}".format(image["gmin"]),
              "--gmax={}".format(image["gmax"]),
              "--blocksize={}".format(b),
-             "--skipmode={}".format(skipmode),
-             image["fn"]],
+             "--skipmode={}".format(skipmode)] +
+            options +
+            [image["fn"]],
             cwd=cwd,
             stdout=subprocess.PIPE, stderr=subprocess.PIPE).communicate()[0].decode('utf-8')
         m = re.search(r"ran [\d]+ frames, averaged ([\d\.]+) fps", output)
@@ -87,7 +89,37 @@ def benchmark_block_sizes(skipmode, bs):
     print(df.to_string())
     df.to_csv("benchmark_results_{}.csv".format(skipmode), index=False)
 
+# Occupancy map kernels at each block size, block skipping so the update time is the occupancy map alone
+def benchmark_occupancy_methods(bs, occupancy_methods):
+    results = []
+    skipmode = 1
+    for image in images:
+        print(image)
+        for b in bs:
+            for occupancy in occupancy_methods:
+                result = get_timing(image, b, skipmode, occupancy)
+                if result:
+                    (framerate, distance_map_time_ms, occupied_voxel_percent) = result
+                    image.update({
+                            "skipmode": int(skipmode),
+                            "blocksize": int(b),
+                            "occupancy_method": int(occupancy),
+                            "occupancy": float(occupied_voxel_percent),
+                            "framerate": float(framerate),
+                            "update": float(distance_map_time_ms)
+                        })
+                    print("\t", b, occupancy, distance_map_time_ms)
+                    results.append(image.copy())
+
+    columns = ["image", "skipmode", "blocksize", "occupancy_method", "occupancy", "framerate", "update", "imin", "imax", "gmin", "gmax"]
+    df = pd.DataFrame(results, columns=columns)
+    print(df.to_string())
+    df.to_csv("benchmark_results_occupancy.csv", index=False)
+
 # Block size benchmarking, was just run once
-for skipmode in [0, 1, 2, 3]:
+for skipmode in [0, 1, 2, 3, 4, 5]:
   bs = [2, 3, 4, 5, 6]
   benchmark_block_sizes(skipmode, bs)
+
+# Occupancy map kernels: 0=Voxels (one invocation per block), 2=VoxelsCooperative, 3=Fused
+benchmark_occupancy_methods([2, 3, 4, 5, 6], [0, 2, 3])
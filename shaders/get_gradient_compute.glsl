@@ -12,10 +12,10 @@ float get_gradient(ivec3 pos, ivec3 dim1) {
     // Gradient on-the-fly using tetrahedron technique http://iquilezles.org/www/articles/normalsSDF/normalsSDF.htm
     ivec2 k = ivec2(1,-1);
     vec3 gradientDir = 0.25f * (
-      k.xyy * imageLoad(volume, clamp(pos + k.xyy, ivec3(0), dim1)).x +
-      k.yyx * imageLoad(volume, clamp(pos + k.yyx, ivec3(0), dim1)).x +
-      k.yxy * imageLoad(volume, clamp(pos + k.yxy, ivec3(0), dim1)).x +
-      k.xxx * imageLoad(volume, clamp(pos + k.xxx, ivec3(0), dim1)).x);
+      k.xyy * window(imageLoad(volume, clamp(pos + k.xyy, ivec3(0), dim1)).x) +
+      k.yyx * window(imageLoad(volume, clamp(pos + k.yyx, ivec3(0), dim1)).x) +
+      k.yxy * window(imageLoad(volume, clamp(pos + k.yxy, ivec3(0), dim1)).x) +
+      k.xxx * window(imageLoad(volume, clamp(pos + k.xxx, ivec3(0), dim1)).x));
     float gradient = clamp(length(gradientDir) * transfer_function_uniform.grad_magnitude_modifier, 0, 1);
     return gradient;
 #endif
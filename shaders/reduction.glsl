@@ -0,0 +1,157 @@
+/* Copyright (c) 2019, Lachlan Deakin
+*
+* SPDX-License-Identifier: Apache-2.0
+*
+* Licensed under the Apache License, Version 2.0 the "License";
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// Single pass reductions for any compute shader, see ComputeReduction
+// Invocations combine values with subgroup operations and shared atomics, then each workgroup applies one global atomic per value
+// Define REDUCTION_SET, REDUCTION_BINDING and any of REDUCE_SUM, REDUCE_MIN_MAX, REDUCE_AABB and REDUCE_HISTOGRAM before including
+// reduction_init() and reduction_flush() must be called from uniform control flow, the reduce_*() functions may be called from anywhere in between
+// Requires GL_KHR_shader_subgroup_arithmetic
+
+layout(set = REDUCTION_SET, binding = REDUCTION_BINDING, std430) buffer reductionBuffer {
+  uint sum_lo;
+  uint sum_hi;
+  uint min_value;  // float bits mapped to an unsigned order, see reduction_order()
+  uint max_value;
+  int aabb_min[4];  // xyz, w is padding
+  int aabb_max[4];
+  uint histogram[256];
+} reduction;
+
+const int REDUCTION_INT_MAX = 0x7fffffff;
+const int REDUCTION_INT_MIN = -REDUCTION_INT_MAX - 1;
+
+#ifdef REDUCE_SUM
+shared uint reduction_sum; // the sum of a workgroup must fit in 32 bits
+#endif
+#ifdef REDUCE_MIN_MAX
+shared uint reduction_min, reduction_max;
+#endif
+#ifdef REDUCE_AABB
+shared int reduction_aabb_min[3], reduction_aabb_max[3];
+#endif
+#ifdef REDUCE_HISTOGRAM
+shared uint reduction_histogram[256];
+#endif
+
+// Maps float bits to unsigned integers with the same order, so atomicMin/atomicMax can be used
+uint reduction_order(float value) {
+  uint bits = floatBitsToUint(value);
+  return (bits & 0x80000000u) != 0 ? ~bits : bits | 0x80000000u;
+}
+
+void reduction_init() {
+  if (gl_LocalInvocationIndex == 0) {
+#ifdef REDUCE_SUM
+    reduction_sum = 0;
+#endif
+#ifdef REDUCE_MIN_MAX
+    reduction_min = ~0u;
+    reduction_max = 0;
+#endif
+#ifdef REDUCE_AABB
+    for (int i = 0; i < 3; ++i) {
+      reduction_aabb_min[i] = REDUCTION_INT_MAX;
+      reduction_aabb_max[i] = REDUCTION_INT_MIN;
+    }
+#endif
+  }
+#ifdef REDUCE_HISTOGRAM
+  const uint n_invocations = gl_WorkGroupSize.x * gl_WorkGroupSize.y * gl_WorkGroupSize.z;
+  for (uint i = gl_LocalInvocationIndex; i < 256; i += n_invocations) {
+    reduction_histogram[i] = 0;
+  }
+#endif
+  barrier();
+}
+
+#ifdef REDUCE_SUM
+void reduce_sum(uint value) {
+  const uint sum_subgroup = subgroupAdd(value);
+  if (subgroupElect() && sum_subgroup != 0) {
+    atomicAdd(reduction_sum, sum_subgroup);
+  }
+}
+#endif
+
+#ifdef REDUCE_MIN_MAX
+void reduce_min_max(float value) {
+  const uint ordered = reduction_order(value);
+  const uint min_subgroup = subgroupMin(ordered);
+  const uint max_subgroup = subgroupMax(ordered);
+  if (subgroupElect()) {
+    atomicMin(reduction_min, min_subgroup);
+    atomicMax(reduction_max, max_subgroup);
+  }
+}
+#endif
+
+#ifdef REDUCE_AABB
+// Grows the bounding box to include pos, call only for the positions to include
+void reduce_aabb(ivec3 pos) {
+  const ivec3 min_subgroup = subgroupMin(pos);
+  const ivec3 max_subgroup = subgroupMax(pos);
+  if (subgroupElect()) {
+    for (int i = 0; i < 3; ++i) {
+      atomicMin(reduction_aabb_min[i], min_subgroup[i]);
+      atomicMax(reduction_aabb_max[i], max_subgroup[i]);
+    }
+  }
+}
+#endif
+
+#ifdef REDUCE_HISTOGRAM
+void reduce_histogram(uint bin) {
+  atomicAdd(reduction_histogram[min(bin, 255u)], 1);
+}
+#endif
+
+void reduction_flush() {
+  barrier();
+  if (gl_LocalInvocationIndex == 0) {
+#ifdef REDUCE_SUM
+    if (reduction_sum != 0) {
+      // 64-bit sum from 32-bit atomics, the high word takes the carry of each wrap of the low word
+      const uint previous = atomicAdd(reduction.sum_lo, reduction_sum);
+      if (previous + reduction_sum < previous) {
+        atomicAdd(reduction.sum_hi, 1);
+      }
+    }
+#endif
+#ifdef REDUCE_MIN_MAX
+    if (reduction_min <= reduction_max) {
+      atomicMin(reduction.min_value, reduction_min);
+      atomicMax(reduction.max_value, reduction_max);
+    }
+#endif
+#ifdef REDUCE_AABB
+    if (reduction_aabb_min[0] <= reduction_aabb_max[0]) {
+      for (int i = 0; i < 3; ++i) {
+        atomicMin(reduction.aabb_min[i], reduction_aabb_min[i]);
+        atomicMax(reduction.aabb_max[i], reduction_aabb_max[i]);
+      }
+    }
+#endif
+  }
+#ifdef REDUCE_HISTOGRAM
+  const uint n_invocations = gl_WorkGroupSize.x * gl_WorkGroupSize.y * gl_WorkGroupSize.z;
+  for (uint i = gl_LocalInvocationIndex; i < 256; i += n_invocations) {
+    if (reduction_histogram[i] != 0) {
+      atomicAdd(reduction.histogram[i], reduction_histogram[i]);
+    }
+  }
+#endif
+}
@@ -20,6 +20,8 @@ layout(set = TRANSFER_FUNCTION_SET, binding = TRANSFER_FUNCTION_BINDING_UNIFORM)
   float voxel_alpha_factor;
   float grad_magnitude_modifier;
   bool use_gradient;
+  float window_scale;
+  float window_offset;
 #ifndef TRANSFER_FUNCTION_BINDING_TEXTURE
   float intensity_min;
   float intensity_range_inv;
@@ -32,6 +34,11 @@ layout(set = TRANSFER_FUNCTION_SET, binding = TRANSFER_FUNCTION_BINDING_UNIFORM)
 layout (set = TRANSFER_FUNCTION_SET, binding = TRANSFER_FUNCTION_BINDING_TEXTURE) uniform sampler2D transfer_function;  // rgba
 #endif
 
+// Maps a volume sample to [0, 1], native 16-bit volumes are windowed here instead of being quantised at load time
+float window(float intensity) {
+  return clamp(intensity * transfer_function_uniform.window_scale + transfer_function_uniform.window_offset, 0, 1);
+}
+
 vec4 get_color(float intensity, float gradient) {
 #ifdef TRANSFER_FUNCTION_BINDING_TEXTURE
   // Map intensity and gradient to colour with transfer function
@@ -27,7 +27,7 @@ layout (input_attachment_index = 0, binding = 0) uniform subpassInput i_depth;
 #endif
 
 layout(location = 0) in vec4 position; // gl_Position
-layout(location = 1) in vec3 ray_entry;
+layout(location = 1) in vec3 ray_entry_in;
 
 layout(set = 0, binding = 1) uniform CameraUniform {
     mat4 view;
@@ -42,10 +42,16 @@ layout(set = 0, binding = 2) uniform RayCastUniform {
     vec4 plane_tex;
     vec4 cam_pos_tex;
     vec4 block_size;
+    vec4 proxy_brick_size;
+    vec4 aabb_min_tex;
+    vec4 aabb_max_tex;
     int front_index;
 } ray_cast_uniform;
 
-layout (set = 0, binding = 5) uniform mediump sampler3D volume;
+#ifndef VOLUME_PRECISION
+#define VOLUME_PRECISION mediump // highp for native 16-bit volumes
+#endif
+layout (set = 0, binding = 5) uniform VOLUME_PRECISION sampler3D volume;
 
 #define TRANSFER_FUNCTION_SET 0
 #define TRANSFER_FUNCTION_BINDING_UNIFORM 3
@@ -57,10 +63,16 @@ layout (set = 0, binding = 6) uniform mediump sampler3D gradient;
 #endif
 #ifdef ANISOTROPIC_DISTANCE
 layout (set = 0, binding = 7) uniform mediump usampler3D distance_map[8];
+#elif defined(HIERARCHICAL_DISTANCE_LEVELS)
+layout (set = 0, binding = 7) uniform mediump usampler3D distance_map[HIERARCHICAL_DISTANCE_LEVELS]; // each level doubles the block size
 #else
 layout (set = 0, binding = 7) uniform mediump usampler3D distance_map[1];
 #endif
 
+#ifdef PROXY_GEOMETRY
+layout (set = 0, binding = 9) uniform mediump usampler3D proxy_bricks;
+#endif
+
 layout(location = 0) out vec4 out_color;
 #ifdef REVERSE_DEPTH
 layout(depth_less) out float gl_FragDepth;
@@ -68,19 +80,99 @@ layout(depth_less) out float gl_FragDepth;
 layout(depth_greater) out float gl_FragDepth;
 #endif
 
-vec3 ray_caster_get_back(const in vec3 front, const in vec3 dir) {
-  // Use AABB ray-box intersection (simplified due to unit cube [0-1]) to get intersection with back
+vec2 ray_caster_get_range(const in vec3 origin, const in vec3 dir, const in vec3 box_min, const in vec3 box_max) {
+  // Use AABB ray-box intersection to get the distances to the front and back of the box
   vec3 dir_inv = 1.0f / dir;
-  vec3 tMin = -front * dir_inv;
-  vec3 tMax = (1.0f - front) * dir_inv;
+  vec3 tMin = (box_min - origin) * dir_inv;
+  vec3 tMax = (box_max - origin) * dir_inv;
   vec3 t1 = min(tMin, tMax);
   vec3 t2 = max(tMin, tMax);
   float tNear = max(max(t1.x, t1.y), t1.z);
   float tFar = min(min(t2.x, t2.y), t2.z);
+  return vec2(tNear, tFar);
+}
+
+// Distance from the camera to the start of the visible ray, the front of the box or the clipping plane
+float ray_caster_get_visible_start(const in vec3 dir, const in float t_near) {
+  vec3 cam = ray_cast_uniform.cam_pos_tex.xyz;
+  float t_start = max(t_near, 0.0f);
+  float plane_dir = dot(ray_cast_uniform.plane_tex.xyz, dir);
+  if (plane_dir > 0.0f) {
+    t_start = max(t_start, -dot(ray_cast_uniform.plane_tex, vec4(cam, 1.0f)) / plane_dir);
+  }
+  return t_start;
+}
+
+#ifdef PROXY_GEOMETRY
+// Front faces of the proxy geometry overlap where occupied bricks are behind each other, only the entry into the first occupied brick along the visible ray is kept
+// The bricks are traversed from the start of the visible ray (the front of the bounding box or the clipping plane) to the entry, so the clipping plane cap is kept only if it is in an occupied brick
+bool is_first_proxy_entry(const in vec3 entry, const in vec3 dir, out float t_start) {
+  vec3 cam = ray_cast_uniform.cam_pos_tex.xyz;
+  t_start = ray_caster_get_visible_start(dir, ray_caster_get_range(cam, dir, ray_cast_uniform.aabb_min_tex.xyz, ray_cast_uniform.aabb_max_tex.xyz).x);
+
+  // Amanatides-Woo traversal in bricks
+  ivec3 dim_bricks_1 = textureSize(proxy_bricks, 0) - 1;
+  vec3 texel_to_brick = 1.0f / ray_cast_uniform.proxy_brick_size.xyz;
+  vec3 dir_brick = dir * texel_to_brick;
+  vec3 dir_brick_inv = 1.0f / dir_brick;
+  vec3 start = (cam + t_start * dir) * texel_to_brick;
+  ivec3 brick = clamp(ivec3(start), ivec3(0), dim_bricks_1);
+  ivec3 brick_entry = clamp(ivec3(entry * texel_to_brick + 1e-3f * sign(dir)), ivec3(0), dim_bricks_1); // the brick entered at entry
+  ivec3 brick_step = ivec3(sign(dir));
+  vec3 t_delta = abs(dir_brick_inv);
+  vec3 t_max = (vec3(brick) + step(0.0f, dir) - start) * dir_brick_inv;
+  ivec3 n = abs(brick_entry - brick);
+  for (int i = 0; i <= n.x + n.y + n.z; ++i) {
+    bool occupied = texelFetch(proxy_bricks, brick, 0).x == 0u;
+    if (all(equal(brick, brick_entry))) {
+      return occupied;
+    } else if (occupied) {
+      return false;
+    }
+    if (t_max.x <= t_max.y && t_max.x <= t_max.z) {
+      brick.x += brick_step.x;
+      t_max.x += t_delta.x;
+    } else if (t_max.y <= t_max.z) {
+      brick.y += brick_step.y;
+      t_max.y += t_delta.y;
+    } else {
+      brick.z += brick_step.z;
+      t_max.z += t_delta.z;
+    }
+  }
+  return true; // precision, the traversal passed beside the entry brick
+}
 
-  // Return the back intersection
-  return tFar * dir + front;
+// Distance from the ray exit back to the last occupied brick along the ray, rays stop there rather than at the back of the bounding box
+float get_proxy_exit_distance(const in vec3 exit, const in vec3 dir, const in float ray_distance) {
+  ivec3 dim_bricks_1 = textureSize(proxy_bricks, 0) - 1;
+  vec3 texel_to_brick = 1.0f / ray_cast_uniform.proxy_brick_size.xyz;
+  vec3 dir_brick_inv = 1.0f / (-dir * texel_to_brick);
+  vec3 start = exit * texel_to_brick;
+  ivec3 brick = clamp(ivec3(start), ivec3(0), dim_bricks_1);
+  ivec3 brick_step = ivec3(sign(-dir));
+  vec3 t_delta = abs(dir_brick_inv);
+  vec3 t_max = (vec3(brick) + step(0.0f, -dir) - start) * dir_brick_inv;
+  float t = 0.0f;
+  while (t < ray_distance && all(greaterThanEqual(brick, ivec3(0))) && all(lessThanEqual(brick, dim_bricks_1))) {
+    if (texelFetch(proxy_bricks, brick, 0).x == 0u) {
+      return t;
+    }
+    t = min(min(t_max.x, t_max.y), t_max.z);
+    if (t_max.x <= t_max.y && t_max.x <= t_max.z) {
+      brick.x += brick_step.x;
+      t_max.x += t_delta.x;
+    } else if (t_max.y <= t_max.z) {
+      brick.y += brick_step.y;
+      t_max.y += t_delta.y;
+    } else {
+      brick.z += brick_step.z;
+      t_max.z += t_delta.z;
+    }
+  }
+  return ray_distance;
 }
+#endif
 
 float get_gradient(vec3 pos, vec3 dim_inv) {
   if (transfer_function_uniform.use_gradient) {
@@ -90,10 +182,10 @@ float get_gradient(vec3 pos, vec3 dim_inv) {
 #else
     // Gradient on-the-fly using tetrahedron technique http://iquilezles.org/www/articles/normalsSDF/normalsSDF.htm
     ivec2 k = ivec2(1,-1);
-    vec3 gradientDir = (k.xyy * texture(volume, pos + dim_inv * k.xyy).x +
-                        k.yyx * texture(volume, pos + dim_inv * k.yyx).x +
-                        k.yxy * texture(volume, pos + dim_inv * k.yxy).x +
-                        k.xxx * texture(volume, pos + dim_inv * k.xxx).x) * 0.25f;
+    vec3 gradientDir = (k.xyy * window(texture(volume, pos + dim_inv * k.xyy).x) +
+                        k.yyx * window(texture(volume, pos + dim_inv * k.yyx).x) +
+                        k.yxy * window(texture(volume, pos + dim_inv * k.yxy).x) +
+                        k.xxx * window(texture(volume, pos + dim_inv * k.xxx).x)) * 0.25f;
     float gradient = clamp(length(gradientDir) * transfer_function_uniform.grad_magnitude_modifier, 0, 1);
 #endif
     return gradient;
@@ -106,6 +198,45 @@ float get_gradient(vec3 pos, vec3 dim_inv) {
 int distance_map_idx;
 #endif
 
+#ifdef PACKED_DISTANCE_MAP_BITS
+// Blocks are packed along x, the first block of a texel in the least significant bits, see distance_map_pack.comp
+const int DISTANCE_MAP_BLOCKS_PER_TEXEL = 8 / PACKED_DISTANCE_MAP_BITS;
+const uint DISTANCE_MAP_MASK = (1u << PACKED_DISTANCE_MAP_BITS) - 1u;
+#endif
+
+// Distance (or empty flag for block skipping) of the block u_i of the distance map for the ray direction
+uint get_distance(ivec3 u_i) {
+#ifdef PACKED_DISTANCE_MAP_BITS
+  ivec3 texel = ivec3(u_i.x / DISTANCE_MAP_BLOCKS_PER_TEXEL, u_i.yz);
+  int shift = (u_i.x % DISTANCE_MAP_BLOCKS_PER_TEXEL) * PACKED_DISTANCE_MAP_BITS;
+#else
+  ivec3 texel = u_i;
+#endif
+#ifdef ANISOTROPIC_DISTANCE
+  uint value = texelFetch(distance_map[distance_map_idx], texel, 0).x;
+#else
+  uint value = texelFetch(distance_map[0], texel, 0).x;
+#endif
+#ifdef PACKED_DISTANCE_MAP_BITS
+  return (value >> shift) & DISTANCE_MAP_MASK;
+#else
+  return value;
+#endif
+}
+
+#ifdef HIERARCHICAL_DISTANCE_LEVELS
+// Distance of the block u_i of a level of the distance map pyramid, the level varies between rays so each map is indexed with a constant
+uint get_distance_level(ivec3 u_i, int level) {
+  uint value = 0u;
+  for (int l = 0; l < HIERARCHICAL_DISTANCE_LEVELS; ++l) {
+    if (l == level) {
+      value = texelFetch(distance_map[l], u_i, 0).x;
+    }
+  }
+  return value;
+}
+#endif
+
 //int skip(vec3 u, ivec3 u_i, vec3 step_dist_texel_inv) {
 //}
 
@@ -143,9 +274,25 @@ void main()
   #endif
 #endif
 
-  // Get ray exit
-  vec3 ray_dir = normalize(ray_entry - ray_cast_uniform.cam_pos_tex.xyz);
-  vec3 ray_exit = ray_caster_get_back(ray_entry, ray_dir);
+  // The rasterised geometry (bounding box of the occupied blocks or proxy bricks) bounds which samples are taken
+  vec3 cam_pos = ray_cast_uniform.cam_pos_tex.xyz;
+  vec3 ray_dir = normalize(ray_entry_in - cam_pos);
+  float t_bound_entry = distance(cam_pos, ray_entry_in);
+  float t_bound_exit = ray_caster_get_range(cam_pos, ray_dir, ray_cast_uniform.aabb_min_tex.xyz, ray_cast_uniform.aabb_max_tex.xyz).y;
+#ifdef PROXY_GEOMETRY
+  float t_start;
+  if (!is_first_proxy_entry(ray_entry_in, ray_dir, t_start)) {
+    discard;
+  }
+  t_bound_exit -= get_proxy_exit_distance(cam_pos + t_bound_exit * ray_dir, ray_dir, t_bound_exit - t_bound_entry);
+#endif
+
+  // Get ray entry and exit
+  // Samples are spaced from the start of the visible ray in the unit cube whatever the bounds, so the bounds never move the sample positions
+  vec2 t_cube = ray_caster_get_range(cam_pos, ray_dir, vec3(0.0f), vec3(1.0f));
+  float t_entry = ray_caster_get_visible_start(ray_dir, t_cube.x);
+  vec3 ray_entry = cam_pos + t_entry * ray_dir;
+  vec3 ray_exit = cam_pos + t_cube.y * ray_dir;
   float ray_distance = distance(ray_entry, ray_exit);
 
 #ifdef DEPTH_ATTACHMENT
@@ -176,25 +323,59 @@ void main()
   ivec3 dim = textureSize(volume, 0);
   int dim_max = max(max(dim.x, dim.y), dim.z);
   int n_steps = int(ceil(float(dim_max) * ray_distance * transfer_function_uniform.sampling_factor));
-  vec3 step_volume = ray_dir * ray_distance / (float(n_steps) - 1.0f);
+  float step_length = ray_distance / (float(n_steps) - 1.0f);
+  vec3 step_volume = ray_dir * step_length;
   float sampling_factor_inv = 1.0f / transfer_function_uniform.sampling_factor;
 
   // This test fixes a performance regression if view is oriented with edge/s of the volume
   // perhaps due to precision issues with the bounding box intersection
   vec3 early_exit_test = ray_entry + step_volume;
-  if (any(lessThanEqual(early_exit_test, vec3(0))) || any(greaterThanEqual(early_exit_test, vec3(1)))) {
+  if (any(lessThanEqual(early_exit_test, vec3(0.0f))) || any(greaterThanEqual(early_exit_test, vec3(1.0f)))) {
     return;
   }
 
+  // Samples outside of the bounds are empty
+  // The bounding box is already widened by a voxel, but sample positions just outside of occupied bricks may have some opacity (due to linear sampling of the volume)
+#if defined(PROXY_GEOMETRY) && !defined(APRON_OCCUPANCY)
+  int bound_margin = int(ceil(transfer_function_uniform.sampling_factor));
+#else
+  int bound_margin = 0;
+#endif
+  int i_begin = clamp(int(floor((t_bound_entry - t_entry) / step_length)) - bound_margin, 0, n_steps);
+  int i_end = clamp(int(ceil((t_bound_exit - t_entry) / step_length)) + 1 + bound_margin, 0, n_steps);
+
 #ifndef DISABLE_SKIP
   // Empty space skipping
   ivec3 dim_distance_map = textureSize(distance_map[0], 0);
+#ifdef PACKED_DISTANCE_MAP_BITS
+  dim_distance_map.x *= DISTANCE_MAP_BLOCKS_PER_TEXEL; // padding blocks are packed as occupied
+#endif
   vec3 volume_to_distance_map_u = vec3(dim) / (vec3(ray_cast_uniform.block_size));
   ivec3 dim_distance_map_1 = dim_distance_map - 1;
   vec3 step_dist_texel = step_volume * vec3(dim) / vec3(ray_cast_uniform.block_size);
   vec3 step_dist_texel_inv = 1.0f / step_dist_texel;
-  int i_min = 0; // furthest sampled step + 1
+  int i_min = i_begin; // furthest sampled step + 1
   ivec3 u_last_alpha = ivec3(0);
+#ifdef HIERARCHICAL_DISTANCE_LEVELS
+  // Skips start from the coarsest level, descend until a level is empty and climb one level after each skip
+  ivec3 dim_distance_map_level_1[HIERARCHICAL_DISTANCE_LEVELS];
+  for (int l = 0; l < HIERARCHICAL_DISTANCE_LEVELS; ++l) {
+    dim_distance_map_level_1[l] = textureSize(distance_map[l], 0) - 1;
+  }
+  int level = HIERARCHICAL_DISTANCE_LEVELS - 1;
+#endif
+#ifdef BLOCK_DDA
+  // Amanatides-Woo traversal of the blocks crossed by the ray, t is measured in steps along the ray
+  vec3 u_entry = volume_to_distance_map_u * (ray_entry + float(i_begin) * step_volume);
+  ivec3 dda_block = clamp(ivec3(u_entry), ivec3(0), dim_distance_map_1);
+  ivec3 dda_step = ivec3(sign(step_dist_texel));
+  // Axes the ray is parallel to have an infinite inverse, select a large finite t instead as 0 * inf is NaN
+  bvec3 dda_parallel = equal(step_dist_texel, vec3(0.0f));
+  vec3 dda_t_delta = mix(abs(step_dist_texel_inv), vec3(1e30f), dda_parallel);
+  vec3 dda_t_max = mix(float(i_begin) + (vec3(dda_block) + step(0.0f, step_dist_texel) - u_entry) * step_dist_texel_inv, vec3(1e30f), dda_parallel); // t of the next block boundary per axis
+  int i_block_entry = i_begin; // first step in dda_block
+  int i_block_exit = i_begin; // first step after the occupied block being marched
+#endif
 #endif
 
 #ifdef SHOW_NUM_SAMPLES
@@ -212,10 +393,52 @@ void main()
   // Step through volume
   bool voxel_occupied = true;
   int i_first_hit = n_steps; // assume ray goes through
-  for (int i = 0; i < n_steps;) {
+  for (int i = i_begin; i < i_end;) {
     vec3 pos = ray_entry + float(i) * step_volume;
     
-    #ifndef DISABLE_SKIP
+    #ifdef BLOCK_DDA
+    if (i >= i_block_exit) {
+      // Visit each block once until the next occupied block, occupied blocks are then marched to their exit without querying the map
+      bool block_occupied = false;
+      while (!block_occupied && i_block_entry < i_end && all(greaterThanEqual(dda_block, ivec3(0))) && all(lessThanEqual(dda_block, dim_distance_map_1))) {
+        #ifdef SHOW_NUM_SAMPLES
+        ++num_distance_samples;
+        #endif
+        block_occupied = get_distance(dda_block) == 0u;
+        float t_exit = min(min(dda_t_max.x, dda_t_max.y), dda_t_max.z);
+        if (block_occupied) {
+          #ifdef SHOW_OCCUPANCY
+          out_color = vec4(vec3(ray_distance * float(i_block_entry) / float(n_steps)), 1.0f); return;
+          #endif
+          #ifdef APRON_OCCUPANCY
+          // The occupancy map covers a one voxel apron around each block, so samples before the block are empty
+          i = max(i_block_entry, i_min);
+          #else
+          // Start a little before the block as sample positions just outside of occupied blocks may have some opacity (due to linear sampling of the volume)
+          i = max(i_block_entry - int(ceil(transfer_function_uniform.sampling_factor)), i_min);
+          #endif
+          i_block_exit = int(ceil(t_exit));
+        }
+
+        // Step to the next block
+        if (dda_t_max.x <= dda_t_max.y && dda_t_max.x <= dda_t_max.z) {
+          dda_block.x += dda_step.x;
+          dda_t_max.x += dda_t_delta.x;
+        } else if (dda_t_max.y <= dda_t_max.z) {
+          dda_block.y += dda_step.y;
+          dda_t_max.y += dda_t_delta.y;
+        } else {
+          dda_block.z += dda_step.z;
+          dda_t_max.z += dda_t_delta.z;
+        }
+        i_block_entry = int(ceil(t_exit));
+      }
+      if (!block_occupied) {
+        break; // the rest of the ray is empty
+      }
+      continue;
+    }
+    #elif !defined(DISABLE_SKIP)
     // Get occupancy/distance map texel coordinate
     vec3 u = volume_to_distance_map_u * pos;
     ivec3 u_i = clamp(ivec3(u), ivec3(0), dim_distance_map_1);
@@ -226,29 +449,51 @@ void main()
       ++num_distance_samples;
       #endif
 
-      #ifdef ANISOTROPIC_DISTANCE
-      uint dist = texelFetch(distance_map[distance_map_idx], u_i, 0).x;
-    #else
-      uint dist = texelFetch(distance_map[0], u_i, 0).x;
-    #endif
+#ifdef HIERARCHICAL_DISTANCE_LEVELS
+      vec3 u_level;
+      ivec3 u_level_i;
+      uint dist;
+      for (;; --level) {
+        u_level = u / float(1 << level);
+        u_level_i = clamp(ivec3(u_level), ivec3(0), dim_distance_map_level_1[level]);
+        dist = get_distance_level(u_level_i, level);
+        if (dist > 0u || level == 0) break;
+        #ifdef SHOW_NUM_SAMPLES
+        ++num_distance_samples;
+        #endif
+      }
+      vec3 r = clamp(u_level_i - u_level, -1.0, 0.0);
+      vec3 skip_texel_inv = step_dist_texel_inv * float(1 << level);
+#else
+      uint dist = get_distance(u_i);
       vec3 r = clamp(u_i - u, -1.0, 0.0);
+      vec3 skip_texel_inv = step_dist_texel_inv;
+#endif
       int i_delta;
       if (dist > 0u) {
     #ifdef BLOCK_SKIP
         // Skip with "block empty space skipping"
-        vec3 i_delta_xyz = (step(0.0f, step_dist_texel_inv) + r) * step_dist_texel_inv;
+        vec3 i_delta_xyz = (step(0.0f, skip_texel_inv) + r) * skip_texel_inv;
     #else
         // Skip with "chebyshev empty space skipping"
-        vec3 i_delta_xyz = (step(0.0f, -step_dist_texel_inv) + sign(step_dist_texel_inv) * float(dist) + r) * step_dist_texel_inv;
+        vec3 i_delta_xyz = (step(0.0f, -skip_texel_inv) + sign(skip_texel_inv) * float(dist) + r) * skip_texel_inv;
     #endif
         i_delta = max(1, int(ceil(min(min(i_delta_xyz.x, i_delta_xyz.y), i_delta_xyz.z))));
         
         // Skip ray forward
         i += i_delta;
+    #ifdef HIERARCHICAL_DISTANCE_LEVELS
+        level = min(level + 1, HIERARCHICAL_DISTANCE_LEVELS - 1);
+    #endif
       } else {
     #ifdef SHOW_OCCUPANCY
         out_color = vec4(vec3(ray_distance * float(i) / float(n_steps)), 1.0f); return;
     #endif
+    #ifdef APRON_OCCUPANCY
+        // The occupancy map covers a one voxel apron around each block, so the skipped samples are empty and sampling starts here
+        voxel_occupied = true;
+        u_last_alpha = u_i;
+    #else
         // Step backwards
         i_delta = -int(ceil(transfer_function_uniform.sampling_factor));
         // NOTE: The ray is stepped backwards as sample positions just outside of occupied blocks may have some opacity (due to linear sampling of the volume)
@@ -259,6 +504,7 @@ void main()
         voxel_occupied = true;
         u_last_alpha = u_i;
         i = max(i + i_delta, i_min);
+    #endif
       }
     }
     else
@@ -269,13 +515,13 @@ void main()
       #endif
 
       // Map to colour and opacity with a transfer function
-      float intensity = texture(volume, pos).x;
+      float intensity = window(texture(volume, pos).x);
       float gradient = get_gradient(pos, dim_inv);
       vec4 color = get_color(intensity, gradient);
 
       voxel_occupied = color.a > 0.0f;
       if (voxel_occupied) {
-        #ifndef DISABLE_SKIP
+        #if !defined(DISABLE_SKIP) && !defined(BLOCK_DDA)
         u_last_alpha = u_i;
         #endif
 
@@ -35,6 +35,9 @@ layout(set = 0, binding = 2) uniform RayCastUniform {
     vec4 plane_tex;
     vec4 cam_pos_tex;
     vec4 block_size;
+    vec4 proxy_brick_size;
+    vec4 aabb_min_tex;
+    vec4 aabb_max_tex;
     int front_index;
 } ray_cast_uniform;
 
@@ -49,15 +52,15 @@ out gl_PerVertex
 
 void main()
 {
+    // Ray entry (in texel coordinates), the unit cube is scaled to the bounding box of the occupied blocks
+    ray_entry = mix(ray_cast_uniform.aabb_min_tex.xyz, ray_cast_uniform.aabb_max_tex.xyz, position + 0.5f);
+
     // Convert to world space
-    vec4 position_world = camera_uniform.model * vec4(position, 1.0f);
+    vec4 position_world = camera_uniform.model * vec4(ray_entry - 0.5f, 1.0f);
 
     // Distance to clip plane
     gl_ClipDistance[0] = dot(ray_cast_uniform.plane, position_world);
 
-    // Ray entry (in texel coordinates)
-    ray_entry = position + 0.5f;
-
     // Output (projection space)
     position_out = camera_uniform.proj * camera_uniform.view * position_world;
     gl_Position = position_out;
@@ -31,6 +31,9 @@ layout(set = 0, binding = 2) uniform RayCastUniform {
     vec4 plane_tex;
     vec4 cam_pos_tex;
     vec4 block_size;
+    vec4 proxy_brick_size;
+    vec4 aabb_min_tex;
+    vec4 aabb_max_tex;
     int front_index;
 } ray_cast_uniform;
 
@@ -107,8 +110,9 @@ void main()
         int vidx1 = vertex_sequence[sequence_index + _V[(int(gl_VertexIndex) * 4 + e) * 2]];
         int vidx2 = vertex_sequence[sequence_index + _V[(int(gl_VertexIndex) * 4 + e) * 2 + 1]];
 
-        vec3 vecV1 = vec3(cube_vertices[vidx1]);
-        vec3 vecV2 = vec3(cube_vertices[vidx2]);
+        // The unit cube is scaled to the bounding box of the occupied blocks
+        vec3 vecV1 = mix(ray_cast_uniform.aabb_min_tex.xyz, ray_cast_uniform.aabb_max_tex.xyz, vec3(cube_vertices[vidx1]));
+        vec3 vecV2 = mix(ray_cast_uniform.aabb_min_tex.xyz, ray_cast_uniform.aabb_max_tex.xyz, vec3(cube_vertices[vidx2]));
         vec3 vecDir = vecV2 - vecV1;
 
         float denom = dot(vecDir, ray_cast_uniform.plane_tex.xyz);
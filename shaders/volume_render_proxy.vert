@@ -0,0 +1,87 @@
+#version 450
+/* Copyright (c) 2019, Lachlan Deakin
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 the "License";
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#extension GL_EXT_clip_cull_distance: enable
+
+precision highp float;
+
+layout(set = 0, binding = 1) uniform CameraUniform {
+    mat4 view;
+    mat4 proj;
+    mat4 view_proj_inv;
+    mat4 model;
+    mat4 model_inv;
+} camera_uniform;
+
+layout(set = 0, binding = 2) uniform RayCastUniform {
+    vec4 plane;
+    vec4 plane_tex;
+    vec4 cam_pos_tex;
+    vec4 block_size;
+    vec4 proxy_brick_size;
+    vec4 aabb_min_tex;
+    vec4 aabb_max_tex;
+    int front_index;
+} ray_cast_uniform;
+
+// Boundary faces of the occupied bricks, see proxy_geometry.comp
+layout(set = 0, binding = 8, std430) readonly buffer ProxyFaces {
+    uint faces[];
+};
+
+layout(location = 0) out vec4 position_out;
+layout(location = 1) out vec3 ray_entry;
+
+out gl_PerVertex 
+{
+    vec4 gl_Position;
+    float gl_ClipDistance[1];
+};
+
+// Corners of a face facing the positive axis as two triangles, counter clockwise from outside like the cube
+// Faces facing the negative axis swap the corner coordinates to flip the winding
+const ivec2 face_corners[6] = ivec2[](ivec2(0, 0), ivec2(1, 0), ivec2(0, 1), ivec2(0, 1), ivec2(1, 0), ivec2(1, 1));
+
+void main()
+{
+    // One instance per face, drawn indirectly
+    uint face = faces[gl_InstanceIndex];
+    ivec3 brick = ivec3(face & 0xffu, (face >> 8) & 0xffu, (face >> 16) & 0xffu);
+    int axis = int(face >> 24) >> 1;
+    bool positive = ((face >> 24) & 1u) == 1u;
+    ivec2 corner = positive ? face_corners[gl_VertexIndex] : face_corners[gl_VertexIndex].yx;
+
+    vec3 brick_corner;
+    brick_corner[axis] = positive ? 1.0f : 0.0f;
+    brick_corner[(axis + 1) % 3] = float(corner.x);
+    brick_corner[(axis + 2) % 3] = float(corner.y);
+
+    // Ray entry (in texel coordinates), bricks are cut to the bounding box of the occupied blocks
+    ray_entry = clamp((vec3(brick) + brick_corner) * ray_cast_uniform.proxy_brick_size.xyz, ray_cast_uniform.aabb_min_tex.xyz, ray_cast_uniform.aabb_max_tex.xyz);
+    vec3 position = ray_entry - 0.5f;
+
+    // Convert to world space
+    vec4 position_world = camera_uniform.model * vec4(position, 1.0f);
+
+    // Distance to clip plane
+    gl_ClipDistance[0] = dot(ray_cast_uniform.plane, position_world);
+
+    // Output (projection space)
+    position_out = camera_uniform.proj * camera_uniform.view * position_world;
+    gl_Position = position_out;
+}
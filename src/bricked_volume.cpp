@@ -0,0 +1,421 @@
+/* Copyright (c) 2019, Lachlan Deakin
+*
+* SPDX-License-Identifier: Apache-2.0
+*
+* Licensed under the Apache License, Version 2.0 the "License";
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "bricked_volume.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include <boost/endian/conversion.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "mapped_file.h"
+#include "parallel_for.h"
+#include "volume_conversion.h"
+
+#undef min
+#undef max
+
+namespace
+{
+const char magic[8] = {'V', 'K', 'V', 'B', 'R', 'I', 'C', 'K'};
+
+template <typename T>
+VoxelBits<T> to_bits(T v)
+{
+	VoxelBits<T> bits;
+	std::memcpy(&bits, &v, sizeof(T));
+	return bits;
+}
+
+template <typename T>
+T from_bits(VoxelBits<T> bits)
+{
+	T v;
+	std::memcpy(&v, &bits, sizeof(T));
+	return v;
+}
+
+// Value of a voxel stored in file byte order
+template <typename T>
+float voxel_value(T v, bool swap)
+{
+	return static_cast<float>(swap ? from_bits<T>(boost::endian::endian_reverse(to_bits(v))) : v);
+}
+
+bool swap_endianness(const LoadVolume::Header &header)
+{
+	return (header.endianness == "big") != (boost::endian::order::native == boost::endian::order::big);
+}
+
+struct BrickGrid
+{
+	VkExtent3D extent;
+	uint32_t   brick_size;
+	uint32_t   nx, ny, nz;
+
+	BrickGrid(VkExtent3D extent, uint32_t brick_size) :
+	    extent(extent),
+	    brick_size(brick_size),
+	    nx((extent.width + brick_size - 1) / brick_size),
+	    ny((extent.height + brick_size - 1) / brick_size),
+	    nz((extent.depth + brick_size - 1) / brick_size)
+	{}
+
+	size_t count() const
+	{
+		return static_cast<size_t>(nx) * static_cast<size_t>(ny) * static_cast<size_t>(nz);
+	}
+
+	// Origin and extent of a brick, clipped to the volume extent
+	void get_brick(size_t index, glm::uvec3 &origin, glm::uvec3 &size) const
+	{
+		origin = glm::uvec3(index % nx, (index / nx) % ny, index / (static_cast<size_t>(nx) * ny)) * brick_size;
+		size   = glm::min(glm::uvec3(brick_size), glm::uvec3(extent.width, extent.height, extent.depth) - origin);
+	}
+};
+
+size_t brick_voxels(const glm::uvec3 &size)
+{
+	return static_cast<size_t>(size.x) * static_cast<size_t>(size.y) * static_cast<size_t>(size.z);
+}
+
+// Expands the bricks overlapping the requested slices straight into the destination
+template <typename T>
+class BrickedReader : public LoadVolume::Reader
+{
+  public:
+	BrickedReader(std::string filename_data, const LoadVolume::Header &header, bool native_16bit) :
+	    region(map_file(filename_data, mapping)),
+	    grid(header.extent, 1),
+	    convert(header.normalisation_range.x, header.normalisation_range.y, header.endianness == "big", LoadVolume::get_format<T>(native_16bit) == VK_FORMAT_R8_UNORM)
+	{
+		using namespace boost::endian;
+
+		format = LoadVolume::get_format<T>(native_16bit);
+
+		const uint8_t *base = static_cast<const uint8_t *>(region.get_address());
+		if (region.get_size() < sizeof(BrickedVolume::FileHeader))
+		{
+			throw std::runtime_error("Bricked data file is truncated");
+		}
+		BrickedVolume::FileHeader file_header;
+		std::memcpy(&file_header, base, sizeof(file_header));
+		if (std::memcmp(file_header.magic, magic, sizeof(magic)) != 0 || little_to_native(file_header.version) != BrickedVolume::version)
+		{
+			throw std::runtime_error("Not a bricked data file or unsupported version");
+		}
+		if (little_to_native(file_header.voxel_size) != sizeof(T) || little_to_native(file_header.brick_size) == 0)
+		{
+			throw std::runtime_error("Bricked data file does not match the header data type");
+		}
+
+		grid = BrickGrid(header.extent, little_to_native(file_header.brick_size));
+		if (region.get_size() < sizeof(file_header) + grid.count() * sizeof(uint64_t))
+		{
+			throw std::runtime_error("Bricked data file is truncated");
+		}
+
+		entries.resize(grid.count());
+		std::memcpy(entries.data(), base + sizeof(file_header), entries.size() * sizeof(uint64_t));
+		for (size_t i = 0; i < entries.size(); ++i)
+		{
+			entries[i] = little_to_native(entries[i]);
+			if (!(entries[i] & BrickedVolume::constant_flag))
+			{
+				glm::uvec3 origin, size;
+				grid.get_brick(i, origin, size);
+				if (entries[i] + brick_voxels(size) * sizeof(T) > region.get_size())
+				{
+					throw std::runtime_error("Bricked data file is corrupt");
+				}
+			}
+		}
+	}
+
+	virtual void read(size_t first_voxel, size_t n_voxels, uint8_t *dst) override
+	{
+		size_t slice_voxels = static_cast<size_t>(grid.extent.width) * static_cast<size_t>(grid.extent.height);
+		if (first_voxel % slice_voxels != 0 || n_voxels % slice_voxels != 0)
+		{
+			throw std::runtime_error("Bricked volumes can only be read in whole slices");
+		}
+		if (n_voxels == 0)
+		{
+			return;
+		}
+
+		uint32_t z_begin = static_cast<uint32_t>(first_voxel / slice_voxels);
+		uint32_t z_end   = static_cast<uint32_t>((first_voxel + n_voxels) / slice_voxels);
+
+		// Every brick writes a disjoint part of the destination
+		size_t first_brick = static_cast<size_t>(z_begin / grid.brick_size) * grid.nx * grid.ny;
+		size_t last_brick  = static_cast<size_t>((z_end - 1) / grid.brick_size + 1) * grid.nx * grid.ny;
+		parallel_for(first_brick, last_brick, 1, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i)
+			{
+				expand_brick(i, z_begin, z_end, dst);
+			}
+		});
+	}
+
+	virtual void prefetch(size_t first_voxel, size_t n_voxels) override
+	{
+		size_t   slice_voxels = static_cast<size_t>(grid.extent.width) * static_cast<size_t>(grid.extent.height);
+		uint32_t z_begin      = static_cast<uint32_t>(first_voxel / slice_voxels);
+		uint32_t z_end        = static_cast<uint32_t>((first_voxel + n_voxels + slice_voxels - 1) / slice_voxels);
+		if (z_end <= z_begin)
+		{
+			return;
+		}
+
+		// Stored bricks are in brick order, so the bricks overlapping a range of slices are contiguous in the file
+		size_t first_brick = static_cast<size_t>(z_begin / grid.brick_size) * grid.nx * grid.ny;
+		size_t last_brick  = static_cast<size_t>((z_end - 1) / grid.brick_size + 1) * grid.nx * grid.ny;
+		size_t begin = region.get_size(), end = 0;
+		for (size_t i = first_brick; i < std::min(last_brick, entries.size()); ++i)
+		{
+			if (!(entries[i] & BrickedVolume::constant_flag))
+			{
+				glm::uvec3 origin, size;
+				grid.get_brick(i, origin, size);
+				begin = std::min<size_t>(begin, entries[i]);
+				end   = std::max<size_t>(end, entries[i] + brick_voxels(size) * sizeof(T));
+			}
+		}
+		prefetch_mapped_range(region, begin, end);
+	}
+
+  private:
+	void expand_brick(size_t index, uint32_t z_begin, uint32_t z_end, uint8_t *dst) const
+	{
+		glm::uvec3 origin, size;
+		grid.get_brick(index, origin, size);
+		uint32_t z0 = std::max(z_begin, origin.z);
+		uint32_t z1 = std::min(z_end, origin.z + size.z);
+
+		size_t   output_size = convert.get_output_size();
+		uint64_t entry       = entries[index];
+		bool     constant    = (entry & BrickedVolume::constant_flag) != 0;
+		uint8_t  value[sizeof(T)]{};
+		if (constant)
+		{
+			T v = from_bits<T>(static_cast<VoxelBits<T>>(entry));
+			convert.convert_range(&v, 1, value);
+		}
+		const T *src = reinterpret_cast<const T *>(static_cast<const uint8_t *>(region.get_address()) + (constant ? 0 : entry));
+
+		for (uint32_t z = z0; z < z1; ++z)
+		{
+			for (uint32_t y = 0; y < size.y; ++y)
+			{
+				uint8_t *row = dst + ((static_cast<size_t>(z - z_begin) * grid.extent.height + origin.y + y) * grid.extent.width + origin.x) * output_size;
+				if (constant && output_size == 1)
+				{
+					std::memset(row, value[0], size.x);
+				}
+				else if (constant)
+				{
+					for (uint32_t x = 0; x < size.x; ++x)
+					{
+						std::memcpy(row + x * output_size, value, output_size);
+					}
+				}
+				else
+				{
+					convert.convert_range(src + (static_cast<size_t>(z - origin.z) * size.y + y) * size.x, size.x, row);
+				}
+			}
+		}
+	}
+
+	boost::interprocess::file_mapping  mapping;
+	boost::interprocess::mapped_region region;
+	BrickGrid                          grid;
+	std::vector<uint64_t>              entries;
+	VolumeConverter<T>                 convert;
+};
+}        // namespace
+
+constexpr uint32_t BrickedVolume::version;
+constexpr uint64_t BrickedVolume::constant_flag;
+
+template <typename T>
+std::unique_ptr<LoadVolume::Reader> BrickedVolume::open(std::string filename_data, const LoadVolume::Header &header, bool native_16bit)
+{
+	return std::make_unique<BrickedReader<T>>(filename_data, header, native_16bit);
+}
+
+BrickedVolume::Statistics BrickedVolume::convert(std::string filename_raw, const LoadVolume::Header &header, std::string filename_bricked, uint32_t brick_size, float threshold)
+{
+	if (brick_size == 0)
+	{
+		throw std::runtime_error("Brick size must be greater than zero");
+	}
+
+	if (header.type == "uint8_t")
+	{
+		return convert_impl<uint8_t>(filename_raw, header, filename_bricked, brick_size, threshold);
+	}
+	else if (header.type == "int8_t")
+	{
+		return convert_impl<int8_t>(filename_raw, header, filename_bricked, brick_size, threshold);
+	}
+	else if (header.type == "uint16_t")
+	{
+		return convert_impl<uint16_t>(filename_raw, header, filename_bricked, brick_size, threshold);
+	}
+	else if (header.type == "int16_t")
+	{
+		return convert_impl<int16_t>(filename_raw, header, filename_bricked, brick_size, threshold);
+	}
+	else if (header.type == "uint32_t")
+	{
+		return convert_impl<uint32_t>(filename_raw, header, filename_bricked, brick_size, threshold);
+	}
+	else if (header.type == "int32_t")
+	{
+		return convert_impl<int32_t>(filename_raw, header, filename_bricked, brick_size, threshold);
+	}
+	else if (header.type == "float")
+	{
+		return convert_impl<float>(filename_raw, header, filename_bricked, brick_size, threshold);
+	}
+	else
+	{
+		throw std::runtime_error("unsupported image data type");
+	}
+}
+
+template <typename T>
+BrickedVolume::Statistics BrickedVolume::convert_impl(std::string filename_raw, const LoadVolume::Header &header, std::string filename_bricked, uint32_t brick_size, float threshold)
+{
+	using namespace boost::endian;
+
+	boost::interprocess::file_mapping  mapping;
+	boost::interprocess::mapped_region region = map_file(filename_raw, mapping);
+
+	BrickGrid grid(header.extent, brick_size);
+	size_t    slice_voxels = static_cast<size_t>(header.extent.width) * static_cast<size_t>(header.extent.height);
+	if (region.get_size() != slice_voxels * header.extent.depth * sizeof(T))
+	{
+		throw std::runtime_error("File size does not match expected size for the given image format/dimensions");
+	}
+	const T *src  = static_cast<const T *>(region.get_address());
+	bool     swap = swap_endianness(header);
+
+	std::ofstream file(filename_bricked, std::ios::binary);
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Failed to open bricked data file for writing");
+	}
+
+	// Bricks are classified and gathered one layer at a time, then written in order
+	std::vector<uint64_t>       entries(grid.count());
+	std::vector<std::vector<T>> layer(static_cast<size_t>(grid.nx) * grid.ny);
+	uint64_t                    offset          = sizeof(FileHeader) + entries.size() * sizeof(uint64_t);
+	size_t                      n_stored_bricks = 0;
+	file.seekp(offset);
+	for (uint32_t bz = 0; bz < grid.nz; ++bz)
+	{
+		size_t layer_begin = static_cast<size_t>(bz) * layer.size();
+		parallel_for(0, layer.size(), 1, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i)
+			{
+				glm::uvec3 origin, size;
+				grid.get_brick(layer_begin + i, origin, size);
+
+				auto &brick = layer[i];
+				brick.resize(brick_voxels(size));
+				T *dst = brick.data();
+				for (uint32_t z = 0; z < size.z; ++z)
+				{
+					for (uint32_t y = 0; y < size.y; ++y)
+					{
+						std::memcpy(dst, src + ((origin.z + z) * slice_voxels + static_cast<size_t>(origin.y + y) * header.extent.width + origin.x), size.x * sizeof(T));
+						dst += size.x;
+					}
+				}
+
+				bool  constant = true, below = true;
+				T     min_voxel = brick[0];
+				float min_value = voxel_value(brick[0], swap);
+				for (T v : brick)
+				{
+					float value = voxel_value(v, swap);
+					constant &= to_bits(v) == to_bits(brick[0]);
+					below &= value <= threshold;
+					if (value < min_value)
+					{
+						min_voxel = v;
+						min_value = value;
+					}
+				}
+
+				if (constant || below)
+				{
+					entries[layer_begin + i] = constant_flag | to_bits(min_voxel);
+					brick.clear();
+				}
+			}
+		});
+
+		for (size_t i = 0; i < layer.size(); ++i)
+		{
+			if (!layer[i].empty())
+			{
+				entries[layer_begin + i] = offset;
+				file.write(reinterpret_cast<const char *>(layer[i].data()), layer[i].size() * sizeof(T));
+				offset += layer[i].size() * sizeof(T);
+				++n_stored_bricks;
+			}
+		}
+	}
+
+	FileHeader file_header{};
+	std::memcpy(file_header.magic, magic, sizeof(magic));
+	file_header.version         = native_to_little(version);
+	file_header.brick_size      = native_to_little(brick_size);
+	file_header.voxel_size      = native_to_little(static_cast<uint32_t>(sizeof(T)));
+	file_header.n_stored_bricks = native_to_little(static_cast<uint64_t>(n_stored_bricks));
+	for (auto &entry : entries)
+	{
+		entry = native_to_little(entry);
+	}
+	file.seekp(0);
+	file.write(reinterpret_cast<const char *>(&file_header), sizeof(file_header));
+	file.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(uint64_t));
+	if (!file)
+	{
+		throw std::runtime_error("Failed to write bricked data file");
+	}
+
+	return {grid.count(), n_stored_bricks, static_cast<size_t>(offset)};
+}
+
+template std::unique_ptr<LoadVolume::Reader> BrickedVolume::open<uint8_t>(std::string, const LoadVolume::Header &, bool);
+template std::unique_ptr<LoadVolume::Reader> BrickedVolume::open<int8_t>(std::string, const LoadVolume::Header &, bool);
+template std::unique_ptr<LoadVolume::Reader> BrickedVolume::open<uint16_t>(std::string, const LoadVolume::Header &, bool);
+template std::unique_ptr<LoadVolume::Reader> BrickedVolume::open<int16_t>(std::string, const LoadVolume::Header &, bool);
+template std::unique_ptr<LoadVolume::Reader> BrickedVolume::open<uint32_t>(std::string, const LoadVolume::Header &, bool);
+template std::unique_ptr<LoadVolume::Reader> BrickedVolume::open<int32_t>(std::string, const LoadVolume::Header &, bool);
+template std::unique_ptr<LoadVolume::Reader> BrickedVolume::open<float>(std::string, const LoadVolume::Header &, bool);
@@ -0,0 +1,75 @@
+/* Copyright (c) 2019, Lachlan Deakin
+*
+* SPDX-License-Identifier: Apache-2.0
+*
+* Licensed under the Apache License, Version 2.0 the "License";
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "load_volume.h"
+
+/**
+ * @brief Sparse bricked volume data file
+ *
+ * The volume is split into cubic bricks of brick_size voxels, bricks at the volume edge are clipped to the extent.
+ * Layout (little endian):
+ *   FileHeader
+ *   uint64_t entry per brick, x fastest, then y, then z
+ *   brick data for each stored brick in the same order, voxels x fastest in the file's data type and endianness
+ * An entry with constant_flag set stores the whole brick as a single voxel value in its low bits, otherwise it is the byte offset of the brick data.
+ * Bricks which are constant, or whose voxels are all at or below a threshold, are stored as a value.
+ *
+ * The accompanying header file is the same as for raw data with a sixth line "bricked".
+ */
+class BrickedVolume
+{
+  public:
+	struct FileHeader
+	{
+		char     magic[8];
+		uint32_t version;
+		uint32_t brick_size;
+		uint32_t voxel_size;
+		uint32_t reserved;
+		uint64_t n_stored_bricks;
+	};
+
+	static constexpr uint32_t version       = 1;
+	static constexpr uint64_t constant_flag = uint64_t(1) << 63;
+
+	struct Statistics
+	{
+		size_t n_bricks;
+		size_t n_stored_bricks;
+		size_t file_size;
+	};
+
+	/**
+	 * @brief Converts a raw volume data file to a bricked data file
+	 * @param threshold Bricks with all voxels at or below this value are stored as their minimum value, which is lossy, -infinity stores only constant bricks as a value
+	 */
+	static Statistics convert(std::string filename_raw, const LoadVolume::Header &header, std::string filename_bricked, uint32_t brick_size, float threshold);
+
+	// Reader which expands whole slices of a bricked data file, see LoadVolume::open()
+	template <typename T>
+	static std::unique_ptr<LoadVolume::Reader> open(std::string filename_data, const LoadVolume::Header &header, bool native_16bit = false);
+
+  private:
+	template <typename T>
+	static Statistics convert_impl(std::string filename_raw, const LoadVolume::Header &header, std::string filename_bricked, uint32_t brick_size, float threshold);
+};
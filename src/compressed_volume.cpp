@@ -0,0 +1,404 @@
+/* Copyright (c) 2019, Lachlan Deakin
+*
+* SPDX-License-Identifier: Apache-2.0
+*
+* Licensed under the Apache License, Version 2.0 the "License";
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "compressed_volume.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/endian/conversion.hpp>
+
+#include "mapped_file.h"
+#include "parallel_for.h"
+#include "volume_conversion.h"
+
+#undef min
+#undef max
+
+namespace
+{
+const char   magic[8]           = {'V', 'K', 'V', 'C', 'O', 'M', 'P', 'R'};
+const size_t group_size         = 64;
+const char * delta_bitpack_name = "delta_bitpack";
+
+template <typename T>
+void encode_delta_bitpack(const T *src, size_t n_voxels, bool swap, std::vector<uint8_t> &out)
+{
+	using Bits           = VoxelBits<T>;
+	const uint32_t nbits = sizeof(Bits) * 8;
+
+	out.clear();
+	Bits     prev = 0;
+	uint64_t zigzag[group_size];
+	for (size_t group = 0; group < n_voxels; group += group_size)
+	{
+		size_t   n         = std::min(group_size, n_voxels - group);
+		uint64_t max_value = 0;
+		for (size_t i = 0; i < group_size; ++i)
+		{
+			if (i < n)
+			{
+				Bits v;
+				std::memcpy(&v, src + group + i, sizeof(Bits));
+				v = swap ? boost::endian::endian_reverse(v) : v;
+
+				// Differences wrap, so zigzag in the width of the voxel type
+				Bits delta = static_cast<Bits>(v - prev);
+				Bits sign  = static_cast<Bits>(0u - static_cast<Bits>(delta >> (nbits - 1)));
+				zigzag[i]  = static_cast<Bits>(static_cast<Bits>(delta << 1) ^ sign);
+				prev       = v;
+			}
+			else
+			{
+				zigzag[i] = 0;
+			}
+			max_value = std::max(max_value, zigzag[i]);
+		}
+
+		uint8_t width = 0;
+		while (width < 64 && (max_value >> width) != 0)
+		{
+			++width;
+		}
+		out.push_back(width);
+
+		// 64 values of width bits always fill whole bytes
+		uint64_t acc      = 0;
+		uint32_t acc_bits = 0;
+		for (size_t i = 0; i < group_size && width > 0; ++i)
+		{
+			acc |= zigzag[i] << acc_bits;
+			acc_bits += width;
+			while (acc_bits >= 8)
+			{
+				out.push_back(static_cast<uint8_t>(acc));
+				acc >>= 8;
+				acc_bits -= 8;
+			}
+		}
+	}
+}
+
+template <typename T>
+void decode_delta_bitpack(const uint8_t *src, const uint8_t *end, size_t n_voxels, T *dst)
+{
+	using Bits           = VoxelBits<T>;
+	const uint32_t nbits = sizeof(Bits) * 8;
+
+	Bits prev = 0;
+	for (size_t group = 0; group < n_voxels; group += group_size)
+	{
+		size_t n = std::min(group_size, n_voxels - group);
+		if (src >= end)
+		{
+			throw std::runtime_error("Compressed chunk is truncated");
+		}
+		uint32_t width = *src++;
+		if (width > nbits || static_cast<size_t>(end - src) < 8 * width)
+		{
+			throw std::runtime_error("Compressed chunk is corrupt");
+		}
+
+		if (width == 0)
+		{
+			T v;
+			std::memcpy(&v, &prev, sizeof(T));
+			std::fill(dst + group, dst + group + n, v);
+			continue;
+		}
+
+		const uint8_t *packed   = src;
+		const uint64_t mask     = (uint64_t(1) << width) - 1;
+		uint64_t       acc      = 0;
+		uint32_t       acc_bits = 0;
+		for (size_t i = 0; i < n; ++i)
+		{
+			while (acc_bits < width)
+			{
+				acc |= uint64_t(*packed++) << acc_bits;
+				acc_bits += 8;
+			}
+			Bits zigzag = static_cast<Bits>(acc & mask);
+			acc >>= width;
+			acc_bits -= width;
+
+			Bits delta = static_cast<Bits>((zigzag >> 1) ^ static_cast<Bits>(0u - static_cast<Bits>(zigzag & 1)));
+			prev       = static_cast<Bits>(prev + delta);
+			std::memcpy(dst + group + i, &prev, sizeof(T));
+		}
+		src += 8 * width;
+	}
+}
+
+// Decompresses the chunks overlapping a request in parallel and converts them straight into the destination
+template <typename T>
+class CompressedReader : public LoadVolume::Reader
+{
+  public:
+	CompressedReader(std::string filename_data, const LoadVolume::Header &header, bool native_16bit) :
+	    region(map_file(filename_data, mapping)),
+	    convert(header.normalisation_range.x, header.normalisation_range.y, boost::endian::order::native == boost::endian::order::big,
+	            LoadVolume::get_format<T>(native_16bit) == VK_FORMAT_R8_UNORM)
+	{
+		using namespace boost::endian;
+
+		format = LoadVolume::get_format<T>(native_16bit);
+
+		n_voxels = static_cast<size_t>(header.extent.width) * static_cast<size_t>(header.extent.height) * static_cast<size_t>(header.extent.depth);
+
+		const uint8_t *base = static_cast<const uint8_t *>(region.get_address());
+		if (region.get_size() < sizeof(CompressedVolume::FileHeader))
+		{
+			throw std::runtime_error("Compressed data file is truncated");
+		}
+		CompressedVolume::FileHeader file_header;
+		std::memcpy(&file_header, base, sizeof(file_header));
+		if (std::memcmp(file_header.magic, magic, sizeof(magic)) != 0 || little_to_native(file_header.version) != CompressedVolume::version)
+		{
+			throw std::runtime_error("Not a compressed data file or unsupported version");
+		}
+		if (little_to_native(file_header.codec) != static_cast<uint32_t>(CompressedVolume::Codec::DeltaBitpack) ||
+		    (!header.codec.empty() && CompressedVolume::codec_from_string(header.codec) != CompressedVolume::Codec::DeltaBitpack))
+		{
+			throw std::runtime_error("Unsupported compression codec");
+		}
+		chunk_voxels    = little_to_native(file_header.chunk_voxels);
+		size_t n_chunks = static_cast<size_t>(little_to_native(file_header.n_chunks));
+		if (little_to_native(file_header.voxel_size) != sizeof(T) || chunk_voxels == 0 || n_chunks != (n_voxels + chunk_voxels - 1) / chunk_voxels)
+		{
+			throw std::runtime_error("Compressed data file does not match the header");
+		}
+		if (region.get_size() < sizeof(file_header) + (n_chunks + 1) * sizeof(uint64_t))
+		{
+			throw std::runtime_error("Compressed data file is truncated");
+		}
+
+		offsets.resize(n_chunks + 1);
+		std::memcpy(offsets.data(), base + sizeof(file_header), offsets.size() * sizeof(uint64_t));
+		for (size_t i = 0; i < offsets.size(); ++i)
+		{
+			offsets[i] = little_to_native(offsets[i]);
+			if (offsets[i] > region.get_size() || (i > 0 && offsets[i] < offsets[i - 1]))
+			{
+				throw std::runtime_error("Compressed data file is corrupt");
+			}
+		}
+	}
+
+	virtual void read(size_t first_voxel, size_t n, uint8_t *dst) override
+	{
+		if (n == 0)
+		{
+			return;
+		}
+		if (first_voxel + n > n_voxels)
+		{
+			throw std::runtime_error("Read past the end of the volume");
+		}
+
+		size_t first_chunk = first_voxel / chunk_voxels;
+		size_t last_chunk  = (first_voxel + n - 1) / chunk_voxels;
+		parallel_for(first_chunk, last_chunk + 1, 1, [&](size_t begin, size_t end) {
+			std::vector<T> chunk(chunk_voxels);
+			for (size_t c = begin; c < end; ++c)
+			{
+				size_t chunk_begin = c * chunk_voxels;
+				size_t chunk_size  = std::min<size_t>(chunk_voxels, n_voxels - chunk_begin);
+				decode(c, chunk_size, chunk.data());
+
+				size_t lo = std::max(first_voxel, chunk_begin);
+				size_t hi = std::min(first_voxel + n, chunk_begin + chunk_size);
+				convert.convert_range(chunk.data() + (lo - chunk_begin), hi - lo, dst + (lo - first_voxel) * convert.get_output_size());
+			}
+		});
+	}
+
+	virtual void prefetch(size_t first_voxel, size_t n) override
+	{
+		if (n == 0 || first_voxel >= n_voxels)
+		{
+			return;
+		}
+		size_t first_chunk = first_voxel / chunk_voxels;
+		size_t last_chunk  = std::min(offsets.size() - 2, (first_voxel + n - 1) / chunk_voxels);
+		prefetch_mapped_range(region, offsets[first_chunk], offsets[last_chunk + 1]);
+	}
+
+  private:
+	void decode(size_t chunk, size_t chunk_size, T *dst) const
+	{
+		const uint8_t *base = static_cast<const uint8_t *>(region.get_address());
+		decode_delta_bitpack(base + offsets[chunk], base + offsets[chunk + 1], chunk_size, dst);
+	}
+
+	boost::interprocess::file_mapping  mapping;
+	boost::interprocess::mapped_region region;
+	VolumeConverter<T>                 convert;
+	size_t                             n_voxels;
+	uint32_t                           chunk_voxels;
+	std::vector<uint64_t>              offsets;
+};
+}        // namespace
+
+constexpr uint32_t CompressedVolume::version;
+
+CompressedVolume::Codec CompressedVolume::codec_from_string(const std::string &codec)
+{
+	if (codec == delta_bitpack_name)
+	{
+		return Codec::DeltaBitpack;
+	}
+	throw std::runtime_error("unsupported compression codec: " + codec);
+}
+
+std::string CompressedVolume::codec_to_string(Codec codec)
+{
+	switch (codec)
+	{
+		case Codec::DeltaBitpack:
+		default:
+			return delta_bitpack_name;
+	}
+}
+
+template <typename T>
+std::unique_ptr<LoadVolume::Reader> CompressedVolume::open(std::string filename_data, const LoadVolume::Header &header, bool native_16bit)
+{
+	return std::make_unique<CompressedReader<T>>(filename_data, header, native_16bit);
+}
+
+CompressedVolume::Statistics CompressedVolume::convert(std::string filename_raw, const LoadVolume::Header &header, std::string filename_compressed, uint32_t chunk_voxels, Codec codec /* = Codec::DeltaBitpack */)
+{
+	if (chunk_voxels == 0)
+	{
+		throw std::runtime_error("Chunk size must be greater than zero");
+	}
+
+	if (header.type == "uint8_t")
+	{
+		return convert_impl<uint8_t>(filename_raw, header, filename_compressed, chunk_voxels, codec);
+	}
+	else if (header.type == "int8_t")
+	{
+		return convert_impl<int8_t>(filename_raw, header, filename_compressed, chunk_voxels, codec);
+	}
+	else if (header.type == "uint16_t")
+	{
+		return convert_impl<uint16_t>(filename_raw, header, filename_compressed, chunk_voxels, codec);
+	}
+	else if (header.type == "int16_t")
+	{
+		return convert_impl<int16_t>(filename_raw, header, filename_compressed, chunk_voxels, codec);
+	}
+	else if (header.type == "uint32_t")
+	{
+		return convert_impl<uint32_t>(filename_raw, header, filename_compressed, chunk_voxels, codec);
+	}
+	else if (header.type == "int32_t")
+	{
+		return convert_impl<int32_t>(filename_raw, header, filename_compressed, chunk_voxels, codec);
+	}
+	else if (header.type == "float")
+	{
+		return convert_impl<float>(filename_raw, header, filename_compressed, chunk_voxels, codec);
+	}
+	else
+	{
+		throw std::runtime_error("unsupported image data type");
+	}
+}
+
+template <typename T>
+CompressedVolume::Statistics CompressedVolume::convert_impl(std::string filename_raw, const LoadVolume::Header &header, std::string filename_compressed, uint32_t chunk_voxels, Codec codec)
+{
+	using namespace boost::endian;
+
+	boost::interprocess::file_mapping  mapping;
+	boost::interprocess::mapped_region region = map_file(filename_raw, mapping);
+
+	size_t n_voxels = static_cast<size_t>(header.extent.width) * static_cast<size_t>(header.extent.height) * static_cast<size_t>(header.extent.depth);
+	if (region.get_size() != n_voxels * sizeof(T))
+	{
+		throw std::runtime_error("File size does not match expected size for the given image format/dimensions");
+	}
+	const T *src  = static_cast<const T *>(region.get_address());
+	bool     swap = (header.endianness == "big") != (order::native == order::big);
+
+	std::ofstream file(filename_compressed, std::ios::binary);
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Failed to open compressed data file for writing");
+	}
+
+	// Compress a batch of chunks in parallel, then write them in order
+	size_t                            n_chunks = (n_voxels + chunk_voxels - 1) / chunk_voxels;
+	std::vector<uint64_t>             offsets(n_chunks + 1);
+	std::vector<std::vector<uint8_t>> batch(ThreadPool::get().get_concurrency() * 4);
+	offsets[0] = sizeof(FileHeader) + offsets.size() * sizeof(uint64_t);
+	file.seekp(offsets[0]);
+	for (size_t batch_begin = 0; batch_begin < n_chunks; batch_begin += batch.size())
+	{
+		size_t batch_end = std::min(n_chunks, batch_begin + batch.size());
+		parallel_for(batch_begin, batch_end, 1, [&](size_t begin, size_t end) {
+			for (size_t c = begin; c < end; ++c)
+			{
+				size_t chunk_begin = c * chunk_voxels;
+				encode_delta_bitpack(src + chunk_begin, std::min<size_t>(chunk_voxels, n_voxels - chunk_begin), swap, batch[c - batch_begin]);
+			}
+		});
+
+		for (size_t c = batch_begin; c < batch_end; ++c)
+		{
+			auto &chunk = batch[c - batch_begin];
+			file.write(reinterpret_cast<const char *>(chunk.data()), chunk.size());
+			offsets[c + 1] = offsets[c] + chunk.size();
+		}
+	}
+
+	FileHeader file_header{};
+	std::memcpy(file_header.magic, magic, sizeof(magic));
+	file_header.version      = native_to_little(version);
+	file_header.codec        = native_to_little(static_cast<uint32_t>(codec));
+	file_header.voxel_size   = native_to_little(static_cast<uint32_t>(sizeof(T)));
+	file_header.chunk_voxels = native_to_little(chunk_voxels);
+	file_header.n_chunks     = native_to_little(static_cast<uint64_t>(n_chunks));
+	size_t file_size         = static_cast<size_t>(offsets.back());
+	for (auto &offset : offsets)
+	{
+		offset = native_to_little(offset);
+	}
+	file.seekp(0);
+	file.write(reinterpret_cast<const char *>(&file_header), sizeof(file_header));
+	file.write(reinterpret_cast<const char *>(offsets.data()), offsets.size() * sizeof(uint64_t));
+	if (!file)
+	{
+		throw std::runtime_error("Failed to write compressed data file");
+	}
+
+	return {n_chunks, file_size};
+}
+
+template std::unique_ptr<LoadVolume::Reader> CompressedVolume::open<uint8_t>(std::string, const LoadVolume::Header &, bool);
+template std::unique_ptr<LoadVolume::Reader> CompressedVolume::open<int8_t>(std::string, const LoadVolume::Header &, bool);
+template std::unique_ptr<LoadVolume::Reader> CompressedVolume::open<uint16_t>(std::string, const LoadVolume::Header &, bool);
+template std::unique_ptr<LoadVolume::Reader> CompressedVolume::open<int16_t>(std::string, const LoadVolume::Header &, bool);
+template std::unique_ptr<LoadVolume::Reader> CompressedVolume::open<uint32_t>(std::string, const LoadVolume::Header &, bool);
+template std::unique_ptr<LoadVolume::Reader> CompressedVolume::open<int32_t>(std::string, const LoadVolume::Header &, bool);
+template std::unique_ptr<LoadVolume::Reader> CompressedVolume::open<float>(std::string, const LoadVolume::Header &, bool);
@@ -0,0 +1,80 @@
+/* Copyright (c) 2019, Lachlan Deakin
+*
+* SPDX-License-Identifier: Apache-2.0
+*
+* Licensed under the Apache License, Version 2.0 the "License";
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "load_volume.h"
+
+/**
+ * @brief Chunked compressed volume data file
+ *
+ * The voxels, in file order, are split into chunks of chunk_voxels which are compressed independently so they can be decompressed in parallel.
+ * Layout (little endian):
+ *   FileHeader
+ *   uint64_t chunk table of n_chunks + 1 byte offsets, chunk i spans [offset[i], offset[i + 1])
+ *   compressed chunks
+ *
+ * The delta_bitpack codec stores the zigzag encoded difference between consecutive voxels in groups of 64.
+ * Each group is a byte holding the bit width of its largest difference followed by the 64 differences packed LSB first, so uniform regions cost one byte per group.
+ * Decompressed voxels are in native byte order.
+ *
+ * The accompanying header file is the same as for raw data with a sixth line "compressed delta_bitpack".
+ */
+class CompressedVolume
+{
+  public:
+	enum class Codec : uint32_t
+	{
+		DeltaBitpack = 1
+	};
+
+	struct FileHeader
+	{
+		char     magic[8];
+		uint32_t version;
+		uint32_t codec;
+		uint32_t voxel_size;
+		uint32_t chunk_voxels;
+		uint64_t n_chunks;
+	};
+
+	static constexpr uint32_t version = 1;
+
+	struct Statistics
+	{
+		size_t n_chunks;
+		size_t file_size;
+	};
+
+	static Codec       codec_from_string(const std::string &codec);
+	static std::string codec_to_string(Codec codec);
+
+	// Compresses a raw volume data file, chunks are compressed in parallel
+	static Statistics convert(std::string filename_raw, const LoadVolume::Header &header, std::string filename_compressed, uint32_t chunk_voxels, Codec codec = Codec::DeltaBitpack);
+
+	// Reader which decompresses the chunks overlapping a request in parallel, see LoadVolume::open()
+	template <typename T>
+	static std::unique_ptr<LoadVolume::Reader> open(std::string filename_data, const LoadVolume::Header &header, bool native_16bit = false);
+
+  private:
+	template <typename T>
+	static Statistics convert_impl(std::string filename_raw, const LoadVolume::Header &header, std::string filename_compressed, uint32_t chunk_voxels, Codec codec);
+};
@@ -0,0 +1,54 @@
+/* Copyright (c) 2019, Lachlan Deakin
+*
+* SPDX-License-Identifier: Apache-2.0
+*
+* Licensed under the Apache License, Version 2.0 the "License";
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#pragma once
+
+#include "core/shader_module.h"
+
+#include "volume_component.h"
+
+namespace vkb
+{
+class RenderContext;
+class CommandBuffer;
+}        // namespace vkb
+
+/**
+ * @brief Builds the per-block intensity and gradient ranges of a volume, see Volume::get_block_statistics()
+ *
+ * The statistics only depend on the volume, its window and the gradient magnitude modifier, so they are built once after loading
+ * and occupancy maps are then derived from them per block without revisiting voxels when the transfer function changes.
+ */
+class ComputeBlockStatistics
+{
+  public:
+	ComputeBlockStatistics(vkb::RenderContext &render_context);
+
+	virtual ~ComputeBlockStatistics() = default;
+
+	// With apron the statistics cover a one voxel apron around each block and are written to Volume::get_block_statistics_apron()
+	void compute(vkb::CommandBuffer &command_buffer, Volume &volume, vkb::BufferAllocation &transfer_function_uniform, bool apron = false);
+
+  private:
+	vkb::RenderContext &render_context;
+
+	vkb::ShaderSource compute_shader;
+
+	vkb::ImageMemoryBarrier memory_barrier_volume_to_compute{};
+	vkb::ImageMemoryBarrier memory_barrier_to_compute{};
+	vkb::ImageMemoryBarrier memory_barrier_compute_to_fragment{};
+};
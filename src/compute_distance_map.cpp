@@ -23,21 +23,73 @@
 
 auto rndUp = [](int x, int y) { return (x + y - 1) / y; };
 
+// Records one barrier for several images, CommandBuffer::image_memory_barrier() records a vkCmdPipelineBarrier per image
+static void image_memory_barriers(vkb::CommandBuffer &command_buffer, const std::vector<const Volume::Image *> &images, const vkb::ImageMemoryBarrier &memory_barrier)
+{
+	std::vector<VkImageMemoryBarrier> barriers;
+	barriers.reserve(images.size());
+	for (auto image : images)
+	{
+		VkImageMemoryBarrier barrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+		barrier.oldLayout           = memory_barrier.old_layout;
+		barrier.newLayout           = memory_barrier.new_layout;
+		barrier.srcAccessMask       = memory_barrier.src_access_mask;
+		barrier.dstAccessMask       = memory_barrier.dst_access_mask;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image               = image->image->get_handle();
+		barrier.subresourceRange    = image->image_view->get_subresource_range();
+		barriers.push_back(barrier);
+	}
+	vkCmdPipelineBarrier(command_buffer.get_handle(), memory_barrier.src_stage_mask, memory_barrier.dst_stage_mask, 0, 0, nullptr, 0, nullptr,
+	                     static_cast<uint32_t>(barriers.size()), barriers.data());
+}
+
 ComputeDistanceMap::ComputeDistanceMap(vkb::RenderContext &render_context) :
     render_context(render_context),
+    volume_sweep(render_context),
+    proxy(render_context),
+    occupied_block_bounds(render_context),
     compute_shader_occupancy("occupancy_map.comp"),
+    compute_shader_occupancy_cooperative("occupancy_map_cooperative.comp"),
+    compute_shader_occupancy_block_statistics("occupancy_block_statistics.comp"),
     compute_shader_distance("distance_map.comp"),
-    compute_shader_distance_anisotropic("distance_map_anisotropic.comp")
+    compute_shader_distance_anisotropic("distance_map_anisotropic.comp"),
+    compute_shader_distance_linear("distance_map_linear.comp"),
+    compute_shader_distance_anisotropic_batched("distance_map_anisotropic_batched.comp"),
+    compute_shader_pack("distance_map_pack.comp"),
+    compute_shader_downsample("distance_map_downsample.comp"),
+    compute_shader_aabb("occupancy_aabb.comp")
 {
+	// The batched anisotropic kernel indexes arrays of storage images by direction
+	anisotropic_batched_supported = render_context.get_device().get_gpu().get_features().shaderStorageImageArrayDynamicIndexing == VK_TRUE;
+	anisotropic_batched           = anisotropic_batched_supported;
+
 	vkb::ShaderVariant variant;
 	variant.add_define("PRECOMPUTED_GRADIENT");
+	vkb::ShaderVariant variant_apron;
+	variant_apron.add_define("APRON");
+	vkb::ShaderVariant variant_apron_gradient;
+	variant_apron_gradient.add_define("APRON");
+	variant_apron_gradient.add_define("PRECOMPUTED_GRADIENT");
 
 	// Build all shaders upfront
 	auto &resource_cache = render_context.get_device().get_resource_cache();
 	resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader_occupancy);
 	resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader_occupancy, variant);
+	resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader_occupancy, variant_apron);
+	resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader_occupancy, variant_apron_gradient);
+	resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader_occupancy_cooperative);
+	resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader_occupancy_cooperative, variant);
+	resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader_occupancy_block_statistics);
 	resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader_distance);
 	resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader_distance_anisotropic);
+	resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader_downsample);
+	resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader_aabb);
+	if (anisotropic_batched_supported)
+	{
+		resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader_distance_anisotropic_batched);
+	}
 
 	// Memory barriers
 	memory_barrier_to_compute.old_layout      = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -47,6 +99,13 @@ ComputeDistanceMap::ComputeDistanceMap(vkb::RenderContext &render_context) :
 	memory_barrier_to_compute.src_stage_mask  = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
 	memory_barrier_to_compute.dst_stage_mask  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
 
+	memory_barrier_read_only_to_compute.old_layout      = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	memory_barrier_read_only_to_compute.new_layout      = VK_IMAGE_LAYOUT_GENERAL;
+	memory_barrier_read_only_to_compute.src_access_mask = 0;
+	memory_barrier_read_only_to_compute.dst_access_mask = VK_ACCESS_SHADER_READ_BIT;
+	memory_barrier_read_only_to_compute.src_stage_mask  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	memory_barrier_read_only_to_compute.dst_stage_mask  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
 	memory_barrier_write_to_read.old_layout      = VK_IMAGE_LAYOUT_GENERAL;
 	memory_barrier_write_to_read.new_layout      = VK_IMAGE_LAYOUT_GENERAL;
 	memory_barrier_write_to_read.src_access_mask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT;
@@ -62,42 +121,228 @@ ComputeDistanceMap::ComputeDistanceMap(vkb::RenderContext &render_context) :
 	memory_barrier_compute_to_fragment.dst_stage_mask  = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
 }
 
-void ComputeDistanceMap::compute(vkb::CommandBuffer &command_buffer, Volume &volume, vkb::BufferAllocation &transfer_function_uniform, VolumeRenderSubpass::SkippingType skipping_type)
+void ComputeDistanceMap::set_occupancy_method(OccupancyMethod method)
+{
+	occupancy_method = method;
+	warn_if_occupancy_method_overridden();
+}
+
+ComputeDistanceMap::OccupancyMethod ComputeDistanceMap::get_occupancy_method() const
+{
+	return occupancy_method;
+}
+
+void ComputeDistanceMap::set_distance_kernel(DistanceKernel kernel)
+{
+	distance_kernel = kernel;
+}
+
+ComputeDistanceMap::DistanceKernel ComputeDistanceMap::get_distance_kernel() const
+{
+	return distance_kernel;
+}
+
+void ComputeDistanceMap::set_anisotropic_batched(bool batched)
+{
+	anisotropic_batched = batched && anisotropic_batched_supported;
+}
+
+bool ComputeDistanceMap::get_anisotropic_batched() const
+{
+	return anisotropic_batched;
+}
+
+void ComputeDistanceMap::set_packed(bool packed)
+{
+	this->packed = packed;
+}
+
+bool ComputeDistanceMap::get_packed() const
+{
+	return packed;
+}
+
+void ComputeDistanceMap::set_proxy_geometry(bool proxy_geometry)
+{
+	this->proxy_geometry = proxy_geometry;
+}
+
+bool ComputeDistanceMap::get_proxy_geometry() const
+{
+	return proxy_geometry;
+}
+
+void ComputeDistanceMap::set_apron(bool apron)
+{
+	this->apron = apron;
+	warn_if_occupancy_method_overridden();
+}
+
+bool ComputeDistanceMap::get_apron() const
+{
+	return apron;
+}
+
+ComputeDistanceMap::OccupancyMethod ComputeDistanceMap::get_evaluated_occupancy_method() const
+{
+	if (apron && (occupancy_method == OccupancyMethod::VoxelsCooperative || occupancy_method == OccupancyMethod::Fused))
+	{
+		return OccupancyMethod::Voxels;
+	}
+	return occupancy_method;
+}
+
+void ComputeDistanceMap::warn_if_occupancy_method_overridden() const
+{
+	if (get_evaluated_occupancy_method() != occupancy_method)
+	{
+		LOGW("Occupancy method {} does not support the apron, occupancy is evaluated per voxel instead", static_cast<int>(occupancy_method));
+	}
+}
+
+void ComputeDistanceMap::compute(vkb::CommandBuffer &command_buffer, Volume &volume, vkb::BufferAllocation &transfer_function_uniform, VolumeRenderSubpass::SkippingType skipping_type,
+                                 ComputeReduction *occupied_voxel_count)
 {
 	bool anisotropic     = skipping_type == VolumeRenderSubpass::SkippingType::AnisotropicDistance;
+	bool hierarchical    = skipping_type == VolumeRenderSubpass::SkippingType::HierarchicalDistance;
 	int  n_distance_maps = anisotropic ? 8 : 1;
 	volume.set_number_of_distance_maps(render_context, n_distance_maps);
-
-	// Occupancy
-	auto &occupancy_map = volume.get_distance_map(n_distance_maps - 1);
-	command_buffer.image_memory_barrier(*occupancy_map.image_view, memory_barrier_to_compute);
-	command_buffer.image_memory_barrier(*volume.get_volume().image_view, memory_barrier_to_compute);
-	if (volume.options.use_precomputed_gradient)
+	if (hierarchical)
 	{
-		command_buffer.image_memory_barrier(*volume.get_gradient().image_view, memory_barrier_to_compute);
+		volume.create_distance_map_levels(render_context);
 	}
-	computeOccupancy(command_buffer, volume, occupancy_map, transfer_function_uniform);
-	if (volume.options.use_precomputed_gradient)
+	if (anisotropic && anisotropic_batched)
+	{
+		volume.set_number_of_distance_map_swaps(render_context, 4);
+	}
+	packed_bits = 0;
+	if (packed && skipping_type != VolumeRenderSubpass::SkippingType::None && !hierarchical)
 	{
-		command_buffer.image_memory_barrier(*volume.get_gradient().image_view, memory_barrier_compute_to_fragment);
+		bool block  = skipping_type == VolumeRenderSubpass::SkippingType::Block || skipping_type == VolumeRenderSubpass::SkippingType::BlockDDA;
+		packed_bits = block ? 1 : 4;
+		volume.set_packed_distance_maps(render_context, n_distance_maps, packed_bits);
 	}
 
+	// Occupancy
+	auto &occupancy_map = volume.get_distance_map(n_distance_maps - 1);
+	computeOccupancyMap(command_buffer, volume, occupancy_map, transfer_function_uniform, occupied_voxel_count);
+
 	// Distance map
 	command_buffer.image_memory_barrier(*volume.get_volume().image_view, memory_barrier_to_compute);
 	command_buffer.image_memory_barrier(*volume.get_distance_map_swap().image_view, memory_barrier_to_compute);
+	vkb::ShaderVariant variant_linear;
+	uint32_t           local_size = 0;
+	bool               linear     = distance_kernel == DistanceKernel::Linear && get_linear_variant(volume, anisotropic, variant_linear, local_size);
 	if (skipping_type == VolumeRenderSubpass::SkippingType::AnisotropicDistance)
 	{
-		computeDistanceAnisotropic(command_buffer, volume);
+		if (linear)
+		{
+			computeDistanceAnisotropicLinear(command_buffer, volume, variant_linear, local_size);
+		}
+		else if (anisotropic_batched)
+		{
+			computeDistanceAnisotropicBatched(command_buffer, volume);
+		}
+		else
+		{
+			computeDistanceAnisotropic(command_buffer, volume);
+		}
 	}
-	else if (skipping_type == VolumeRenderSubpass::SkippingType::Distance)
+	else if (skipping_type == VolumeRenderSubpass::SkippingType::Distance || hierarchical)
 	{
-		computeDistance(command_buffer, volume);
+		if (linear)
+		{
+			computeDistanceLinear(command_buffer, volume, variant_linear, local_size);
+		}
+		else
+		{
+			computeDistance(command_buffer, volume.get_distance_map(), volume.get_distance_map_swap());
+		}
+		if (hierarchical)
+		{
+			computeDistanceLevels(command_buffer, volume);
+		}
 	}
 	else
 	{
 		command_buffer.image_memory_barrier(*occupancy_map.image_view, memory_barrier_compute_to_fragment);
 	}
 	command_buffer.image_memory_barrier(*volume.get_volume().image_view, memory_barrier_compute_to_fragment);
+
+	if (packed_bits > 0)
+	{
+		packDistanceMaps(command_buffer, volume, n_distance_maps, packed_bits);
+	}
+
+	computeOccupiedBlockBounds(command_buffer, volume);
+
+	if (proxy_geometry)
+	{
+		proxy.compute(command_buffer, volume);
+	}
+}
+
+void ComputeDistanceMap::update_occupied_block_bounds(Volume &volume)
+{
+	auto result = occupied_block_bounds.get_result();
+	volume.set_occupied_block_bounds(result.aabb_min, result.aabb_max);
+}
+
+void ComputeDistanceMap::release_packed_distance_maps(Volume &volume) const
+{
+	if (packed_bits > 0)
+	{
+		volume.release_distance_maps();
+	}
+}
+
+void ComputeDistanceMap::compute_occupancy(vkb::CommandBuffer &command_buffer, Volume &volume, vkb::BufferAllocation &transfer_function_uniform)
+{
+	auto &occupancy_map = volume.get_distance_map_swap();
+	computeOccupancyMap(command_buffer, volume, occupancy_map, transfer_function_uniform);
+	command_buffer.image_memory_barrier(*occupancy_map.image_view, memory_barrier_compute_to_fragment);
+	if (get_evaluated_occupancy_method() != OccupancyMethod::BlockStatistics)
+	{
+		command_buffer.image_memory_barrier(*volume.get_volume().image_view, memory_barrier_compute_to_fragment);
+	}
+}
+
+void ComputeDistanceMap::computeOccupancyMap(vkb::CommandBuffer &command_buffer, Volume &volume, const Volume::Image &occupancy_map,
+                                             vkb::BufferAllocation &transfer_function_uniform, ComputeReduction *occupied_voxel_count)
+{
+	auto method = get_evaluated_occupancy_method();
+	command_buffer.image_memory_barrier(*occupancy_map.image_view, memory_barrier_to_compute);
+	if (method == OccupancyMethod::BlockStatistics)
+	{
+		auto &block_statistics = apron ? volume.get_block_statistics_apron() : volume.get_block_statistics();
+		command_buffer.image_memory_barrier(*block_statistics.image_view, memory_barrier_read_only_to_compute);
+		computeOccupancyFromBlockStatistics(command_buffer, volume, occupancy_map, transfer_function_uniform);
+		command_buffer.image_memory_barrier(*block_statistics.image_view, memory_barrier_compute_to_fragment);
+	}
+	else
+	{
+		command_buffer.image_memory_barrier(*volume.get_volume().image_view, memory_barrier_to_compute);
+		if (volume.options.use_precomputed_gradient)
+		{
+			// Keep the contents of the gradient map, the sweep only rewrites it when it is outdated
+			auto memory_barrier_gradient = memory_barrier_read_only_to_compute;
+			memory_barrier_gradient.dst_access_mask |= VK_ACCESS_SHADER_WRITE_BIT;
+			command_buffer.image_memory_barrier(*volume.get_gradient().image_view, memory_barrier_gradient);
+		}
+		if (method == OccupancyMethod::Fused)
+		{
+			volume_sweep.compute(command_buffer, volume, transfer_function_uniform, occupancy_map, occupied_voxel_count);
+			command_buffer.image_memory_barrier(*occupancy_map.image_view, memory_barrier_write_to_read);
+		}
+		else
+		{
+			computeOccupancy(command_buffer, volume, occupancy_map, transfer_function_uniform);
+		}
+		if (volume.options.use_precomputed_gradient)
+		{
+			command_buffer.image_memory_barrier(*volume.get_gradient().image_view, memory_barrier_compute_to_fragment);
+		}
+	}
 }
 
 void ComputeDistanceMap::computeOccupancy(vkb::CommandBuffer &command_buffer, const Volume &volume, const Volume::Image &occupancy_map,
@@ -117,9 +362,15 @@ void ComputeDistanceMap::computeOccupancy(vkb::CommandBuffer &command_buffer, co
 	{
 		variant.add_define("PRECOMPUTED_GRADIENT");
 	}
+	if (apron)
+	{
+		variant.add_define("APRON");
+	}
+	volume.add_shader_defines(variant);
 
+	bool  cooperative     = get_evaluated_occupancy_method() == OccupancyMethod::VoxelsCooperative;
 	auto &resource_cache  = command_buffer.get_device().get_resource_cache();
-	auto &shader_module   = resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader_occupancy, variant);
+	auto &shader_module   = resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, cooperative ? compute_shader_occupancy_cooperative : compute_shader_occupancy, variant);
 	auto &pipeline_layout = resource_cache.request_pipeline_layout({&shader_module});
 
 	// Bind pipeline layout and images
@@ -134,20 +385,47 @@ void ComputeDistanceMap::computeOccupancy(vkb::CommandBuffer &command_buffer, co
 	command_buffer.bind_input(*occupancy_map.image_view, 0, 4, 0);
 
 	command_buffer.push_constants(glm::ivec4(block_size, 0));
+	if (cooperative)
+	{
+		// One workgroup per 4^3 tile of blocks
+		command_buffer.dispatch(rndUp(extent.width, 4), rndUp(extent.height, 4), rndUp(extent.depth, 4));
+	}
+	else
+	{
+		command_buffer.dispatch(rndUp(extent.width, 8), rndUp(extent.height, 8), rndUp(extent.depth, 8));
+	}
+
+	command_buffer.image_memory_barrier(*occupancy_map.image_view, memory_barrier_write_to_read);
+}
+
+void ComputeDistanceMap::computeOccupancyFromBlockStatistics(vkb::CommandBuffer &command_buffer, const Volume &volume, const Volume::Image &occupancy_map,
+                                                             vkb::BufferAllocation &transfer_function_uniform)
+{
+	auto &resource_cache  = command_buffer.get_device().get_resource_cache();
+	auto &shader_module   = resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader_occupancy_block_statistics);
+	auto &pipeline_layout = resource_cache.request_pipeline_layout({&shader_module});
+
+	// Bind pipeline layout, images and buffers
+	auto &transfer_function_occupancy = volume.get_transfer_function_occupancy();
+	command_buffer.bind_pipeline_layout(pipeline_layout);
+	command_buffer.bind_input(*(apron ? volume.get_block_statistics_apron() : volume.get_block_statistics()).image_view, 0, 0, 0);
+	command_buffer.bind_buffer(transfer_function_uniform.get_buffer(), transfer_function_uniform.get_offset(), transfer_function_uniform.get_size(), 0, 1, 0);
+	command_buffer.bind_buffer(transfer_function_occupancy, 0, transfer_function_occupancy.get_size(), 0, 2, 0);
+	command_buffer.bind_input(*occupancy_map.image_view, 0, 3, 0);
+
+	auto extent = occupancy_map.image->get_extent();
 	command_buffer.dispatch(rndUp(extent.width, 8), rndUp(extent.height, 8), rndUp(extent.depth, 8));
 
 	command_buffer.image_memory_barrier(*occupancy_map.image_view, memory_barrier_write_to_read);
 }
 
-void ComputeDistanceMap::computeDistance(vkb::CommandBuffer &command_buffer, const Volume &volume)
+void ComputeDistanceMap::computeDistance(vkb::CommandBuffer &command_buffer, const Volume::Image &distance, const Volume::Image &swap)
 {
 	auto &resource_cache  = command_buffer.get_device().get_resource_cache();
 	auto &shader_module   = resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader_distance);
 	auto &pipeline_layout = resource_cache.request_pipeline_layout({&shader_module});
 
-	auto &distance = volume.get_distance_map();        // also the occupancy map, done in-place
-	auto &swap     = volume.get_distance_map_swap();
-
+	// distance is also the occupancy map, done in-place, swap may be larger than distance
 	command_buffer.image_memory_barrier(*distance.image_view, memory_barrier_to_compute);
 
 	// Bind pipeline layout and images
@@ -174,6 +452,35 @@ void ComputeDistanceMap::computeDistance(vkb::CommandBuffer &command_buffer, con
 	command_buffer.image_memory_barrier(*distance.image_view, memory_barrier_compute_to_fragment);
 }
 
+void ComputeDistanceMap::computeDistanceLevels(vkb::CommandBuffer &command_buffer, const Volume &volume)
+{
+	auto &resource_cache  = command_buffer.get_device().get_resource_cache();
+	auto &shader_module   = resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader_downsample);
+	auto &pipeline_layout = resource_cache.request_pipeline_layout({&shader_module});
+
+	// The swap image of the first level is large enough for every coarser level
+	auto &swap = volume.get_distance_map_swap();
+
+	for (size_t level = 1; level < Volume::distance_map_levels; ++level)
+	{
+		auto &fine   = volume.get_distance_map_level(level - 1);
+		auto &coarse = volume.get_distance_map_level(level);
+
+		// Coarse occupancy from the finer distance map
+		command_buffer.image_memory_barrier(*fine.image_view, memory_barrier_read_only_to_compute);
+		command_buffer.image_memory_barrier(*coarse.image_view, memory_barrier_to_compute);
+		command_buffer.bind_pipeline_layout(pipeline_layout);
+		command_buffer.bind_input(*fine.image_view, 0, 0, 0);
+		command_buffer.bind_input(*coarse.image_view, 0, 1, 0);
+		auto extent = coarse.image->get_extent();
+		command_buffer.dispatch(rndUp(extent.width, 8), rndUp(extent.height, 8), rndUp(extent.depth, 8));
+		command_buffer.image_memory_barrier(*fine.image_view, memory_barrier_compute_to_fragment);
+		command_buffer.image_memory_barrier(*coarse.image_view, memory_barrier_write_to_read);
+
+		computeDistance(command_buffer, coarse, swap);
+	}
+}
+
 void ComputeDistanceMap::computeDistanceAnisotropic(vkb::CommandBuffer &command_buffer, const Volume &volume)
 {
 	auto &resource_cache  = command_buffer.get_device().get_resource_cache();
@@ -288,3 +595,246 @@ void ComputeDistanceMap::computeDistanceAnisotropic(vkb::CommandBuffer &command_
 		command_buffer.image_memory_barrier(*distance.image_view, memory_barrier_compute_to_fragment);
 	}
 }
+
+void ComputeDistanceMap::computeDistanceAnisotropicBatched(vkb::CommandBuffer &command_buffer, const Volume &volume)
+{
+	auto &resource_cache  = command_buffer.get_device().get_resource_cache();
+	auto &shader_module   = resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader_distance_anisotropic_batched);
+	auto &pipeline_layout = resource_cache.request_pipeline_layout({&shader_module});
+
+	auto &occupancy_map = volume.get_distance_map(7);
+	auto  extent        = occupancy_map.image->get_extent();
+
+	// The +x/-x passes go to distance maps 0 and 1, which are only written again by the last stage
+	// The 4 xy passes go to the swap images, the last stage writes every distance map
+	command_buffer.bind_pipeline_layout(pipeline_layout);
+	command_buffer.bind_input(*occupancy_map.image_view, 0, 0, 0);
+	std::vector<const Volume::Image *> swaps, distances;
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		swaps.push_back(&volume.get_distance_map_swap(i));
+	}
+	for (uint32_t i = 0; i < 8; ++i)
+	{
+		distances.push_back(&volume.get_distance_map(i));
+	}
+	for (uint32_t i = 0; i < 2; ++i)
+	{
+		command_buffer.bind_input(*distances[i]->image_view, 0, 1, i);
+	}
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		command_buffer.bind_input(*swaps[i]->image_view, 0, 2, i);
+	}
+	for (uint32_t i = 0; i < 8; ++i)
+	{
+		command_buffer.bind_input(*distances[i]->image_view, 0, 3, i);
+	}
+	// The occupancy map in distance map 7 is already in the general layout
+	std::vector<const Volume::Image *> outputs(swaps);
+	outputs.insert(outputs.end(), distances.begin(), distances.end() - 1);
+	image_memory_barriers(command_buffer, outputs, memory_barrier_to_compute);
+
+	// Dispatch 1st stage, 2 directions
+	command_buffer.push_constants<uint32_t>(0);
+	command_buffer.dispatch(rndUp(extent.height, 8), rndUp(extent.depth, 8), 2);
+	image_memory_barriers(command_buffer, {distances[0], distances[1]}, memory_barrier_write_to_read);
+
+	// Dispatch 2nd stage, 4 directions
+	command_buffer.push_constants<uint32_t>(1);
+	command_buffer.dispatch(rndUp(extent.width, 8), rndUp(extent.depth, 8), 4);
+	image_memory_barriers(command_buffer, swaps, memory_barrier_write_to_read);
+
+	// Dispatch 3rd stage, 8 directions
+	command_buffer.push_constants<uint32_t>(2);
+	command_buffer.dispatch(rndUp(extent.width, 8), rndUp(extent.height, 8), 8);
+	image_memory_barriers(command_buffer, distances, memory_barrier_compute_to_fragment);
+}
+
+void ComputeDistanceMap::computeOccupiedBlockBounds(vkb::CommandBuffer &command_buffer, const Volume &volume)
+{
+	auto &resource_cache  = command_buffer.get_device().get_resource_cache();
+	auto &shader_module   = resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader_aabb);
+	auto &pipeline_layout = resource_cache.request_pipeline_layout({&shader_module});
+
+	// Every distance map is zero at the occupied blocks
+	auto &occupancy_map = volume.get_distance_map();
+	auto  extent        = occupancy_map.image->get_extent();
+
+	occupied_block_bounds.begin(command_buffer);
+	command_buffer.image_memory_barrier(*occupancy_map.image_view, memory_barrier_read_only_to_compute);
+	command_buffer.bind_pipeline_layout(pipeline_layout);
+	command_buffer.bind_input(*occupancy_map.image_view, 0, 0, 0);
+	occupied_block_bounds.bind(command_buffer, 0, 1);
+	command_buffer.dispatch(rndUp(extent.width, 8), rndUp(extent.height, 8), rndUp(extent.depth, 8));
+	command_buffer.image_memory_barrier(*occupancy_map.image_view, memory_barrier_compute_to_fragment);
+	occupied_block_bounds.end(command_buffer);
+}
+
+void ComputeDistanceMap::packDistanceMaps(vkb::CommandBuffer &command_buffer, const Volume &volume, size_t n_distance_maps, uint32_t bits)
+{
+	vkb::ShaderVariant variant;
+	variant.add_define("PACKED_BITS " + std::to_string(bits));
+
+	auto &resource_cache  = command_buffer.get_device().get_resource_cache();
+	auto &shader_module   = resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader_pack, variant);
+	auto &pipeline_layout = resource_cache.request_pipeline_layout({&shader_module});
+	command_buffer.bind_pipeline_layout(pipeline_layout);
+
+	for (size_t i = 0; i < n_distance_maps; ++i)
+	{
+		auto &distance        = volume.get_distance_map(i);
+		auto &packed_distance = volume.get_packed_distance_map(i);
+		auto  extent          = packed_distance.image->get_extent();
+		command_buffer.image_memory_barrier(*distance.image_view, memory_barrier_read_only_to_compute);
+		command_buffer.image_memory_barrier(*packed_distance.image_view, memory_barrier_to_compute);
+		command_buffer.bind_input(*distance.image_view, 0, 0, 0);
+		command_buffer.bind_input(*packed_distance.image_view, 0, 1, 0);
+		command_buffer.dispatch(rndUp(extent.width, 8), rndUp(extent.height, 8), rndUp(extent.depth, 8));
+		command_buffer.image_memory_barrier(*distance.image_view, memory_barrier_compute_to_fragment);
+		command_buffer.image_memory_barrier(*packed_distance.image_view, memory_barrier_compute_to_fragment);
+	}
+}
+
+bool ComputeDistanceMap::get_linear_variant(const Volume &volume, bool anisotropic, vkb::ShaderVariant &variant, uint32_t &local_size) const
+{
+	auto     extent          = volume.get_distance_map_swap().image->get_extent();
+	uint32_t scanline_length = std::max(extent.height, extent.depth);
+	uint32_t scanline_size   = rndUp(scanline_length, 4) * 4;
+	uint32_t shared_memory   = render_context.get_device().get_gpu().get_properties().limits.maxComputeSharedMemorySize;
+
+	local_size = 64;
+	while (local_size > 1 && local_size * scanline_size > shared_memory)
+	{
+		local_size /= 2;
+	}
+	if (local_size * scanline_size > shared_memory)
+	{
+		LOGW("Distance map scanlines of {} blocks do not fit in shared memory, falling back to the zig-zag kernel", scanline_length);
+		return false;
+	}
+
+	variant.add_define("LOCAL_SIZE " + std::to_string(local_size));
+	variant.add_define("SCANLINE_LENGTH " + std::to_string(scanline_length));
+	if (anisotropic)
+	{
+		variant.add_define("ANISOTROPIC");
+	}
+	return true;
+}
+
+void ComputeDistanceMap::computeDistanceLinear(vkb::CommandBuffer &command_buffer, const Volume &volume, vkb::ShaderVariant &variant, uint32_t local_size)
+{
+	auto &resource_cache = command_buffer.get_device().get_resource_cache();
+
+	auto &distance = volume.get_distance_map();        // also the occupancy map, done in-place
+	auto &swap     = volume.get_distance_map_swap();
+	auto  extent   = distance.image->get_extent();
+
+	command_buffer.image_memory_barrier(*distance.image_view, memory_barrier_to_compute);
+
+	// Dispatch 1st stage, already linear
+	{
+		auto &shader_module   = resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader_distance);
+		auto &pipeline_layout = resource_cache.request_pipeline_layout({&shader_module});
+		command_buffer.bind_pipeline_layout(pipeline_layout);
+		command_buffer.bind_input(*distance.image_view, 0, 0, 0);
+		command_buffer.bind_input(*distance.image_view, 0, 1, 0);
+		command_buffer.push_constants<uint32_t>(0);
+		command_buffer.dispatch(rndUp(extent.height, 8), rndUp(extent.depth, 8), 1);
+		command_buffer.image_memory_barrier(*distance.image_view, memory_barrier_write_to_read);
+	}
+
+	auto &shader_module   = resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader_distance_linear, variant);
+	auto &pipeline_layout = resource_cache.request_pipeline_layout({&shader_module});
+	command_buffer.bind_pipeline_layout(pipeline_layout);
+
+	// Dispatch 2nd stage, links overwrite the cached input
+	command_buffer.bind_input(*distance.image_view, 0, 0, 0);
+	command_buffer.bind_input(*distance.image_view, 0, 1, 0);
+	command_buffer.bind_input(*swap.image_view, 0, 2, 0);
+	command_buffer.push_constants<uint32_t>(1);
+	command_buffer.dispatch(rndUp(extent.width, local_size), extent.depth, 1);
+	command_buffer.image_memory_barrier(*distance.image_view, memory_barrier_write_to_read);
+	command_buffer.image_memory_barrier(*swap.image_view, memory_barrier_write_to_read);
+
+	// Dispatch 3rd stage
+	command_buffer.bind_input(*swap.image_view, 0, 0, 0);
+	command_buffer.bind_input(*swap.image_view, 0, 1, 0);
+	command_buffer.bind_input(*distance.image_view, 0, 2, 0);
+	command_buffer.push_constants<uint32_t>(2);
+	command_buffer.dispatch(rndUp(extent.width, local_size), extent.height, 1);
+
+	command_buffer.image_memory_barrier(*distance.image_view, memory_barrier_compute_to_fragment);
+}
+
+void ComputeDistanceMap::computeDistanceAnisotropicLinear(vkb::CommandBuffer &command_buffer, const Volume &volume, vkb::ShaderVariant &variant, uint32_t local_size)
+{
+	auto &resource_cache = command_buffer.get_device().get_resource_cache();
+
+	auto &occupancy_map = volume.get_distance_map(7);
+	auto &swap          = volume.get_distance_map_swap();
+	auto  extent        = occupancy_map.image->get_extent();
+
+	for (int i = 0; i < 8; ++i)
+	{
+		auto &distance = volume.get_distance_map(i);
+		command_buffer.image_memory_barrier(*distance.image_view, memory_barrier_to_compute);
+	}
+
+	struct PushConstants
+	{
+		uint32_t stage;
+		int32_t  direction;
+	};
+
+	// 1st stage with the zig-zag kernel, which is already linear
+	auto stage1 = [&](size_t distance_map_idx, int32_t direction) {
+		auto &shader_module   = resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader_distance_anisotropic);
+		auto &pipeline_layout = resource_cache.request_pipeline_layout({&shader_module});
+		auto &distance        = volume.get_distance_map(distance_map_idx);
+		command_buffer.bind_pipeline_layout(pipeline_layout);
+		command_buffer.push_constants<PushConstants>({0, direction});
+		command_buffer.bind_input(*distance.image_view, 0, 0, 0);
+		command_buffer.bind_input(*occupancy_map.image_view, 0, 1, 0);
+		command_buffer.dispatch(rndUp(extent.height, 8), rndUp(extent.depth, 8), 1);
+		command_buffer.image_memory_barrier(*distance.image_view, memory_barrier_write_to_read);
+	};
+
+	// 2nd and 3rd stages compute both directions from one input
+	auto stage23 = [&](uint32_t stage, const Volume::Image &input, const Volume::Image &links, const Volume::Image &output_positive, const Volume::Image &output_negative) {
+		auto &shader_module   = resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader_distance_linear, variant);
+		auto &pipeline_layout = resource_cache.request_pipeline_layout({&shader_module});
+		command_buffer.bind_pipeline_layout(pipeline_layout);
+		command_buffer.push_constants<uint32_t>(stage);
+		command_buffer.bind_input(*input.image_view, 0, 0, 0);
+		command_buffer.bind_input(*links.image_view, 0, 1, 0);
+		command_buffer.bind_input(*output_positive.image_view, 0, 2, 0);
+		command_buffer.bind_input(*output_negative.image_view, 0, 3, 0);
+		command_buffer.dispatch(rndUp(extent.width, local_size), stage == 1 ? extent.depth : extent.height, 1);
+		command_buffer.image_memory_barrier(*input.image_view, memory_barrier_write_to_read);
+		command_buffer.image_memory_barrier(*links.image_view, memory_barrier_write_to_read);
+		command_buffer.image_memory_barrier(*output_positive.image_view, memory_barrier_write_to_read);
+		command_buffer.image_memory_barrier(*output_negative.image_view, memory_barrier_write_to_read);
+	};
+
+	// Same distance maps as computeDistanceAnisotropic(), each pair of directions shares a dispatch
+	// and links go to the input or to an image which is not written yet
+	auto map = [&](size_t idx) -> const Volume::Image & { return volume.get_distance_map(idx); };
+
+	stage1(3, 1);
+	stage23(1, map(3), map(3), swap, map(2));
+	stage23(2, swap, swap, map(0), map(1));
+	stage23(2, map(2), swap, map(2), map(3));
+
+	stage1(7, -1);
+	stage23(1, map(7), map(7), swap, map(6));
+	stage23(2, swap, swap, map(4), map(5));
+	stage23(2, map(6), swap, map(6), map(7));
+
+	for (int i = 0; i < 8; ++i)
+	{
+		auto &distance = volume.get_distance_map(i);
+		command_buffer.image_memory_barrier(*distance.image_view, memory_barrier_compute_to_fragment);
+	}
+}
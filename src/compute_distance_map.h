@@ -19,6 +19,9 @@
 
 #include "core/shader_module.h"
 
+#include "compute_proxy_geometry.h"
+#include "compute_reduction.h"
+#include "compute_volume_sweep.h"
 #include "volume_component.h"
 #include "volume_render_subpass.h"
 
@@ -35,18 +38,105 @@ class ComputeDistanceMap
 
 	virtual ~ComputeDistanceMap() = default;
 
-	void compute(vkb::CommandBuffer &command_buffer, Volume &volume, vkb::BufferAllocation &transfer_function_uniform, VolumeRenderSubpass::SkippingType skipping_type);
+	enum class OccupancyMethod : int
+	{
+		Voxels            = 0,        // evaluate the transfer function at every voxel
+		BlockStatistics   = 1,        // test the range of each block, see Volume::get_block_statistics()
+		VoxelsCooperative = 2,        // evaluate every voxel, a workgroup scans a tile of blocks with coalesced loads
+		Fused             = 3         // evaluate every voxel in one sweep which also writes the occupied voxel counts and an outdated gradient map, see ComputeVolumeSweep
+	};
+
+	enum class DistanceKernel : int
+	{
+		ZigZag = 0,        // search outwards from each voxel, cost grows with the distance
+		Linear = 1         // lower envelope per scanline, see distance_map_linear.comp
+	};
+
+	void            set_occupancy_method(OccupancyMethod method);
+	OccupancyMethod get_occupancy_method() const;
+
+	void           set_distance_kernel(DistanceKernel kernel);
+	DistanceKernel get_distance_kernel() const;
+
+	// Dispatch every direction of an anisotropic stage at once where the device supports it (the default), see distance_map_anisotropic_batched.comp
+	void set_anisotropic_batched(bool batched);
+	bool get_anisotropic_batched() const;
+
+	// Also pack the maps for the ray caster, 4 bits per block for distance maps and 1 bit per block for block skipping, see Volume::get_packed_distance_map()
+	void set_packed(bool packed);
+	bool get_packed() const;
+
+	// Also extract the occupied brick proxy geometry for the ray caster, see ComputeProxyGeometry
+	void set_proxy_geometry(bool proxy_geometry);
+	bool get_proxy_geometry() const;
+
+	// Evaluate occupancy over a one voxel apron around each block, so occupied blocks cover every non-empty linearly interpolated sample
+	// OccupancyMethod::BlockStatistics then reads Volume::get_block_statistics_apron(), the cooperative and fused methods fall back to OccupancyMethod::Voxels
+	void set_apron(bool apron);
+	bool get_apron() const;
+
+	// With OccupancyMethod::Fused the occupied voxels are also counted into the sum of occupied_voxel_count if given
+	void compute(vkb::CommandBuffer &command_buffer, Volume &volume, vkb::BufferAllocation &transfer_function_uniform, VolumeRenderSubpass::SkippingType skipping_type,
+	             ComputeReduction *occupied_voxel_count = nullptr);
+
+	// Stores the bounding box of the occupied blocks found by the last compute() in the volume, see Volume::get_occupied_block_min()
+	// The command buffer of compute() must have completed
+	void update_occupied_block_bounds(Volume &volume);
+
+	// Frees the 8-bit distance maps if the last compute() packed them, so only the packed maps stay allocated while rendering
+	// The command buffer of compute() must have completed, the maps are recreated by the next compute()
+	void release_packed_distance_maps(Volume &volume) const;
+
+	// Computes the occupancy map alone into the distance map swap image, which is left in the shader read only layout, e.g. as the input of a CPU reference
+	void compute_occupancy(vkb::CommandBuffer &command_buffer, Volume &volume, vkb::BufferAllocation &transfer_function_uniform);
 
   private:
+	// The occupancy method used by computeOccupancyMap(), only the voxel and block statistics methods evaluate the apron
+	OccupancyMethod get_evaluated_occupancy_method() const;
+	void            warn_if_occupancy_method_overridden() const;
+
+	void computeOccupancyMap(vkb::CommandBuffer &command_buffer, Volume &volume, const Volume::Image &occupancy_map, vkb::BufferAllocation &transfer_function_uniform,
+	                         ComputeReduction *occupied_voxel_count = nullptr);
 	void computeOccupancy(vkb::CommandBuffer &command_buffer, const Volume &volume, const Volume::Image &occupancy_map, vkb::BufferAllocation &transfer_function_uniform);
-	void computeDistance(vkb::CommandBuffer &command_buffer, const Volume &volume);
+	void computeOccupancyFromBlockStatistics(vkb::CommandBuffer &command_buffer, const Volume &volume, const Volume::Image &occupancy_map, vkb::BufferAllocation &transfer_function_uniform);
+	void computeDistance(vkb::CommandBuffer &command_buffer, const Volume::Image &distance, const Volume::Image &swap);
+	void computeDistanceLevels(vkb::CommandBuffer &command_buffer, const Volume &volume);
 	void computeDistanceAnisotropic(vkb::CommandBuffer &command_buffer, const Volume &volume);
+	void computeDistanceAnisotropicBatched(vkb::CommandBuffer &command_buffer, const Volume &volume);
+	void computeOccupiedBlockBounds(vkb::CommandBuffer &command_buffer, const Volume &volume);
+	void packDistanceMaps(vkb::CommandBuffer &command_buffer, const Volume &volume, size_t n_distance_maps, uint32_t bits);
+	void computeDistanceLinear(vkb::CommandBuffer &command_buffer, const Volume &volume, vkb::ShaderVariant &variant, uint32_t local_size);
+	void computeDistanceAnisotropicLinear(vkb::CommandBuffer &command_buffer, const Volume &volume, vkb::ShaderVariant &variant, uint32_t local_size);
+
+	// Sizes the workgroups of the linear kernel so the cached scanlines fit in shared memory, returns false if a single scanline does not fit
+	bool get_linear_variant(const Volume &volume, bool anisotropic, vkb::ShaderVariant &variant, uint32_t &local_size) const;
 
 	vkb::RenderContext &render_context;
 
-	vkb::ShaderSource compute_shader_occupancy, compute_shader_distance, compute_shader_distance_anisotropic;
+	vkb::ShaderSource compute_shader_occupancy, compute_shader_occupancy_cooperative, compute_shader_occupancy_block_statistics, compute_shader_distance, compute_shader_distance_anisotropic, compute_shader_distance_linear, compute_shader_distance_anisotropic_batched, compute_shader_pack, compute_shader_downsample, compute_shader_aabb;
+
+	ComputeVolumeSweep   volume_sweep;
+	ComputeProxyGeometry proxy;
+	ComputeReduction     occupied_block_bounds;
+
+	OccupancyMethod occupancy_method = OccupancyMethod::BlockStatistics;
+	DistanceKernel  distance_kernel  = DistanceKernel::ZigZag;
+
+	// Every direction of an anisotropic stage in one dispatch, see distance_map_anisotropic_batched.comp
+	bool anisotropic_batched           = false;
+	bool anisotropic_batched_supported = false;
+
+	bool packed = false;
+
+	// Bits per block of the maps packed by the last compute(), 0 if they were not packed
+	uint32_t packed_bits = 0;
+
+	bool proxy_geometry = false;
+
+	bool apron = false;
 
 	vkb::ImageMemoryBarrier memory_barrier_to_compute{};
+	vkb::ImageMemoryBarrier memory_barrier_read_only_to_compute{};
 	vkb::ImageMemoryBarrier memory_barrier_write_to_read{};
 	vkb::ImageMemoryBarrier memory_barrier_compute_to_fragment{};
 };
\ No newline at end of file
@@ -62,8 +62,11 @@ void ComputeGradientMap::compute(vkb::CommandBuffer &command_buffer, Volume &vol
 	command_buffer.image_memory_barrier(*volume_tex.image_view, memory_barrier_to_compute);
 	command_buffer.image_memory_barrier(*gradient_tex.image_view, memory_barrier_to_compute);
 
+	vkb::ShaderVariant variant;
+	volume.add_shader_defines(variant);
+
 	auto &resource_cache  = command_buffer.get_device().get_resource_cache();
-	auto &shader_module   = resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader);
+	auto &shader_module   = resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader, variant);
 	auto &pipeline_layout = resource_cache.request_pipeline_layout({&shader_module});
 
 	// Bind pipeline layout and images
@@ -0,0 +1,53 @@
+/* Copyright (c) 2019, Lachlan Deakin
+*
+* SPDX-License-Identifier: Apache-2.0
+*
+* Licensed under the Apache License, Version 2.0 the "License";
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#pragma once
+
+#include "core/shader_module.h"
+
+#include "volume_component.h"
+
+namespace vkb
+{
+class RenderContext;
+class CommandBuffer;
+}        // namespace vkb
+
+/**
+ * @brief Builds the joint intensity x gradient histogram of a volume, see Volume::get_histogram()
+ *
+ * Intensities are windowed and gradients scaled exactly as the transfer function sees them, so the histogram can be used to pick transfer function ranges.
+ */
+class ComputeHistogram
+{
+  public:
+	ComputeHistogram(vkb::RenderContext &render_context);
+
+	virtual ~ComputeHistogram() = default;
+
+	vkb::core::Buffer     initialise_buffer(vkb::Device &device);
+	void                  compute(vkb::CommandBuffer &command_buffer, Volume &volume, vkb::BufferAllocation &buffer, vkb::BufferAllocation &transfer_function_uniform);
+	std::vector<uint32_t> get_result(vkb::BufferAllocation &buffer) const;
+
+  private:
+	vkb::RenderContext &render_context;
+
+	vkb::ShaderSource compute_shader;
+
+	vkb::ImageMemoryBarrier memory_barrier_to_compute{};
+	vkb::ImageMemoryBarrier memory_barrier_compute_to_fragment{};
+};
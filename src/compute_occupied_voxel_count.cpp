@@ -28,17 +28,8 @@ auto rndUp = [](int x, int y) { return (x + y - 1) / y; };
 ComputeOccupiedVoxelCount::ComputeOccupiedVoxelCount(vkb::RenderContext &render_context) :
     render_context(render_context),
     compute_shader("occupied_voxel_count.comp"),
-    compute_shader_reduce("occupied_voxel_count_reduce.comp")
+    reduction(render_context)
 {
-	// Get subgroup size
-	VkPhysicalDeviceSubgroupProperties subgroup_properties{};
-	subgroup_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
-	VkPhysicalDeviceProperties2 properties{};
-	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
-	properties.pNext = &subgroup_properties;
-	vkGetPhysicalDeviceProperties2(render_context.get_device().get_gpu().get_handle(), &properties);
-	subgroup_size = subgroup_properties.subgroupSize;
-
 	// Build all shaders upfront
 	vkb::ShaderVariant variant;
 	variant.add_define("PRECOMPUTED_GRADIENT");
@@ -46,9 +37,6 @@ ComputeOccupiedVoxelCount::ComputeOccupiedVoxelCount(vkb::RenderContext &render_
 	resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader);
 	resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader, variant);
 
-	variant_reduce.add_define("SUBGROUP_SIZE " + std::to_string(subgroup_size));
-	resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader_reduce, variant_reduce);
-
 	memory_barrier_compute.old_layout      = VK_IMAGE_LAYOUT_UNDEFINED;
 	memory_barrier_compute.new_layout      = VK_IMAGE_LAYOUT_GENERAL;
 	memory_barrier_compute.src_access_mask = VK_ACCESS_SHADER_WRITE_BIT;
@@ -64,20 +52,7 @@ ComputeOccupiedVoxelCount::ComputeOccupiedVoxelCount(vkb::RenderContext &render_
 	memory_barrier_shader_read_only_optimal.dst_stage_mask  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
 }
 
-vkb::core::Buffer ComputeOccupiedVoxelCount::initialise_buffer(vkb::Device &device, Volume &volume)
-{
-	const VkExtent3D   extent = volume.get_volume().image->get_extent();
-	const glm::uvec3   dispatchSize(rndUp(extent.width, 8), rndUp(extent.height, 8), rndUp(extent.depth, 8));
-	const VkDeviceSize nElements =
-	    static_cast<VkDeviceSize>(dispatchSize.x) * static_cast<VkDeviceSize>(dispatchSize.y) *
-	    static_cast<VkDeviceSize>(dispatchSize.z) * static_cast<VkDeviceSize>(8 * 8 * 8 / subgroup_size);
-	const VkDeviceSize bufferSize = sizeof(uint64_t) * nElements;
-	vkb::core::Buffer  buffer(device, bufferSize,
-                             VkBufferUsageFlagBits::VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VkBufferUsageFlagBits::VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VmaMemoryUsage::VMA_MEMORY_USAGE_GPU_TO_CPU);
-	return buffer;
-}
-
-void ComputeOccupiedVoxelCount::compute(vkb::CommandBuffer &command_buffer, Volume &volume, vkb::BufferAllocation &buffer, vkb::BufferAllocation &transfer_function_uniform)
+void ComputeOccupiedVoxelCount::compute(vkb::CommandBuffer &command_buffer, Volume &volume, vkb::BufferAllocation &transfer_function_uniform)
 {
 	auto &resource_cache = command_buffer.get_device().get_resource_cache();
 
@@ -85,15 +60,16 @@ void ComputeOccupiedVoxelCount::compute(vkb::CommandBuffer &command_buffer, Volu
 	command_buffer.image_memory_barrier(*volume.get_volume().image_view, memory_barrier_compute);
 
 	// Run the count
+	reduction.begin(command_buffer);
 	{
 		vkb::ShaderVariant variant;
 		if (volume.options.use_precomputed_gradient)
 		{
 			variant.add_define("PRECOMPUTED_GRADIENT");
 		}
+		volume.add_shader_defines(variant);
 
-		auto &shader_module = resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader, variant);
-		shader_module.set_resource_mode("countBuffer", vkb::ShaderResourceMode::Dynamic);
+		auto &shader_module   = resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader, variant);
 		auto &pipeline_layout = resource_cache.request_pipeline_layout({&shader_module});
 		command_buffer.bind_pipeline_layout(pipeline_layout);
 		command_buffer.bind_input(*volume.get_volume().image_view, 0, 0, 0);
@@ -104,7 +80,7 @@ void ComputeOccupiedVoxelCount::compute(vkb::CommandBuffer &command_buffer, Volu
 			command_buffer.image_memory_barrier(*volume.get_gradient().image_view, memory_barrier_compute);
 			command_buffer.bind_input(*volume.get_gradient().image_view, 0, 3, 0);
 		}
-		command_buffer.bind_buffer(buffer.get_buffer(), buffer.get_offset(), buffer.get_size(), 0, 4, 0);
+		reduction.bind(command_buffer, 0, 4);
 		const VkExtent3D extent = volume.get_volume().image->get_extent();
 		const glm::uvec3 dispatchSize(rndUp(extent.width, 8), rndUp(extent.height, 8), rndUp(extent.depth, 8));
 		command_buffer.dispatch(dispatchSize.x, dispatchSize.y, dispatchSize.z);
@@ -114,43 +90,15 @@ void ComputeOccupiedVoxelCount::compute(vkb::CommandBuffer &command_buffer, Volu
 			command_buffer.image_memory_barrier(*volume.get_gradient().image_view, memory_barrier_shader_read_only_optimal);
 		}
 	}
+	reduction.end(command_buffer);
+}
 
-	// Run the reduce operations
-	{
-		auto &shader_module   = resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader_reduce, variant_reduce);
-		auto &pipeline_layout = resource_cache.request_pipeline_layout({&shader_module});
-		command_buffer.bind_pipeline_layout(pipeline_layout);
-		command_buffer.bind_buffer(buffer.get_buffer(), buffer.get_offset(), buffer.get_size(), 0, 0, 0);
-
-		uint32_t                 stride        = 1;
-		vkb::BufferMemoryBarrier barrier;
-		barrier.src_access_mask = barrier.dst_access_mask =
-		    VkAccessFlagBits::VK_ACCESS_SHADER_READ_BIT | VkAccessFlagBits::VK_ACCESS_SHADER_WRITE_BIT;
-		barrier.src_stage_mask = barrier.dst_stage_mask =
-		    VkPipelineStageFlagBits::VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
-
-		auto         rndUp64   = [](uint64_t x, uint64_t y) { return (x + y - 1) / y; };
-		const size_t nElements = buffer.get_size() / sizeof(uint64_t);
-		while (stride < nElements)
-		{
-			struct PushConstants
-			{
-				uint64_t n_elements;
-				uint32_t stride;
-			} pc = {static_cast<uint64_t>(nElements), stride};
-			command_buffer.push_constants(pc);
-			command_buffer.dispatch(static_cast<uint32_t>(rndUp64(nElements, static_cast<uint64_t>(subgroup_size) * static_cast<uint64_t>(stride))), 1, 1);
-			command_buffer.buffer_memory_barrier(buffer.get_buffer(), buffer.get_offset(), buffer.get_size(), barrier);
-			stride *= subgroup_size;
-		}
-	}
+uint64_t ComputeOccupiedVoxelCount::get_result()
+{
+	return reduction.get_result().sum;
 }
 
-uint64_t ComputeOccupiedVoxelCount::get_result(vkb::BufferAllocation &buffer) const
+ComputeReduction &ComputeOccupiedVoxelCount::get_reduction()
 {
-	buffer.get_buffer().flush();        // FIXME: Needed?
-	auto     data  = buffer.get_buffer().map() + buffer.get_offset();
-	uint64_t count = reinterpret_cast<const uint64_t *>(data)[0];
-	buffer.get_buffer().unmap();
-	return count;
+	return reduction;
 }
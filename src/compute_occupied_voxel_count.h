@@ -19,6 +19,7 @@
 
 #include "core/shader_module.h"
 
+#include "compute_reduction.h"
 #include "volume_component.h"
 #include "volume_render_subpass.h"
 
@@ -35,17 +36,18 @@ class ComputeOccupiedVoxelCount
 
 	virtual ~ComputeOccupiedVoxelCount() = default;
 
-	vkb::core::Buffer initialise_buffer(vkb::Device &device, Volume &volume);
-	void              compute(vkb::CommandBuffer &command_buffer, Volume &volume, vkb::BufferAllocation &buffer, vkb::BufferAllocation &transfer_function_uniform);
-	uint64_t          get_result(vkb::BufferAllocation &buffer) const;
+	void     compute(vkb::CommandBuffer &command_buffer, Volume &volume, vkb::BufferAllocation &transfer_function_uniform);
+	uint64_t get_result();
+
+	// The count is the sum of the reduction, other passes can count into it instead, see ComputeVolumeSweep
+	ComputeReduction &get_reduction();
 
   private:
 	vkb::RenderContext &render_context;
 
-	vkb::ShaderSource compute_shader, compute_shader_reduce;
+	vkb::ShaderSource compute_shader;
 
 	vkb::ImageMemoryBarrier memory_barrier_compute, memory_barrier_shader_read_only_optimal{};
 
-	uint32_t           subgroup_size;
-	vkb::ShaderVariant variant_reduce;
+	ComputeReduction reduction;
 };
\ No newline at end of file
@@ -0,0 +1,148 @@
+/* Copyright (c) 2019, Lachlan Deakin
+*
+* SPDX-License-Identifier: Apache-2.0
+*
+* Licensed under the Apache License, Version 2.0 the "License";
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "compute_proxy_geometry.h"
+
+#include "common/vk_common.h"
+#include "platform/filesystem.h"
+#include "rendering/render_context.h"
+
+auto rndUp = [](int x, int y) { return (x + y - 1) / y; };
+
+namespace
+{
+struct PushConstants
+{
+	glm::ivec4 brick_blocks;
+	uint32_t   stage;
+};
+}        // namespace
+
+ComputeProxyGeometry::ComputeProxyGeometry(vkb::RenderContext &render_context) :
+    render_context(render_context),
+    compute_shader("proxy_geometry.comp")
+{
+	// Build all shaders upfront
+	auto &resource_cache = render_context.get_device().get_resource_cache();
+	resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader);
+
+	// Memory barriers
+	memory_barrier_read_only_to_compute.old_layout      = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	memory_barrier_read_only_to_compute.new_layout      = VK_IMAGE_LAYOUT_GENERAL;
+	memory_barrier_read_only_to_compute.src_access_mask = 0;
+	memory_barrier_read_only_to_compute.dst_access_mask = VK_ACCESS_SHADER_READ_BIT;
+	memory_barrier_read_only_to_compute.src_stage_mask  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	memory_barrier_read_only_to_compute.dst_stage_mask  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+	memory_barrier_to_compute.old_layout      = VK_IMAGE_LAYOUT_UNDEFINED;
+	memory_barrier_to_compute.new_layout      = VK_IMAGE_LAYOUT_GENERAL;
+	memory_barrier_to_compute.src_access_mask = 0;
+	memory_barrier_to_compute.dst_access_mask = VK_ACCESS_SHADER_WRITE_BIT;
+	memory_barrier_to_compute.src_stage_mask  = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	memory_barrier_to_compute.dst_stage_mask  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+	memory_barrier_write_to_read.old_layout      = VK_IMAGE_LAYOUT_GENERAL;
+	memory_barrier_write_to_read.new_layout      = VK_IMAGE_LAYOUT_GENERAL;
+	memory_barrier_write_to_read.src_access_mask = VK_ACCESS_SHADER_WRITE_BIT;
+	memory_barrier_write_to_read.dst_access_mask = VK_ACCESS_SHADER_READ_BIT;
+	memory_barrier_write_to_read.src_stage_mask  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	memory_barrier_write_to_read.dst_stage_mask  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+	memory_barrier_compute_to_fragment.old_layout      = VK_IMAGE_LAYOUT_GENERAL;
+	memory_barrier_compute_to_fragment.new_layout      = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	memory_barrier_compute_to_fragment.src_access_mask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT;
+	memory_barrier_compute_to_fragment.dst_access_mask = VK_ACCESS_SHADER_READ_BIT;
+	memory_barrier_compute_to_fragment.src_stage_mask  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	memory_barrier_compute_to_fragment.dst_stage_mask  = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+}
+
+void ComputeProxyGeometry::compute(vkb::CommandBuffer &command_buffer, Volume &volume)
+{
+	volume.create_proxy_geometry(render_context);
+
+	auto &occupancy_map = volume.get_distance_map();
+	auto &bricks        = volume.get_proxy_bricks();
+	auto &faces         = volume.get_proxy_faces();
+	auto &draw          = volume.get_proxy_draw();
+
+	// Reset the draw to a quad (two triangles) per instance and no instances
+	vkb::BufferMemoryBarrier barrier_to_transfer;
+	barrier_to_transfer.src_access_mask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	barrier_to_transfer.dst_access_mask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier_to_transfer.src_stage_mask  = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+	barrier_to_transfer.dst_stage_mask  = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	command_buffer.buffer_memory_barrier(draw, 0, draw.get_size(), barrier_to_transfer);
+
+	VkDrawIndexedIndirectCommand draw_command{6, 0, 0, 0, 0};
+	vkCmdUpdateBuffer(command_buffer.get_handle(), draw.get_handle(), 0, sizeof(draw_command), &draw_command);
+
+	vkb::BufferMemoryBarrier barrier_transfer_to_compute;
+	barrier_transfer_to_compute.src_access_mask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier_transfer_to_compute.dst_access_mask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	barrier_transfer_to_compute.src_stage_mask  = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	barrier_transfer_to_compute.dst_stage_mask  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	command_buffer.buffer_memory_barrier(draw, 0, draw.get_size(), barrier_transfer_to_compute);
+
+	// The face buffer may still be read by the vertex shader of an earlier frame
+	vkb::BufferMemoryBarrier barrier_faces_to_compute;
+	barrier_faces_to_compute.src_access_mask = VK_ACCESS_SHADER_READ_BIT;
+	barrier_faces_to_compute.dst_access_mask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier_faces_to_compute.src_stage_mask  = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+	barrier_faces_to_compute.dst_stage_mask  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	command_buffer.buffer_memory_barrier(faces, 0, faces.get_size(), barrier_faces_to_compute);
+
+	auto &resource_cache  = command_buffer.get_device().get_resource_cache();
+	auto &shader_module   = resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader);
+	auto &pipeline_layout = resource_cache.request_pipeline_layout({&shader_module});
+
+	command_buffer.image_memory_barrier(*occupancy_map.image_view, memory_barrier_read_only_to_compute);
+	command_buffer.image_memory_barrier(*bricks.image_view, memory_barrier_to_compute);
+	command_buffer.bind_pipeline_layout(pipeline_layout);
+	command_buffer.bind_input(*occupancy_map.image_view, 0, 0, 0);
+	command_buffer.bind_input(*bricks.image_view, 0, 1, 0);
+	command_buffer.bind_buffer(faces, 0, faces.get_size(), 0, 2, 0);
+	command_buffer.bind_buffer(draw, 0, draw.get_size(), 0, 3, 0);
+
+	auto          extent = bricks.image->get_extent();
+	PushConstants push_constants{glm::ivec4(static_cast<int>(volume.get_proxy_brick_blocks())), 0};
+
+	// Brick occupancy
+	command_buffer.push_constants(push_constants);
+	command_buffer.dispatch(rndUp(extent.width, 4), rndUp(extent.height, 4), rndUp(extent.depth, 4));
+	command_buffer.image_memory_barrier(*bricks.image_view, memory_barrier_write_to_read);
+	command_buffer.image_memory_barrier(*occupancy_map.image_view, memory_barrier_compute_to_fragment);
+
+	// Boundary faces
+	push_constants.stage = 1;
+	command_buffer.push_constants(push_constants);
+	command_buffer.dispatch(rndUp(extent.width, 4), rndUp(extent.height, 4), rndUp(extent.depth, 4));
+	command_buffer.image_memory_barrier(*bricks.image_view, memory_barrier_compute_to_fragment);
+
+	vkb::BufferMemoryBarrier barrier_faces_to_vertex;
+	barrier_faces_to_vertex.src_access_mask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier_faces_to_vertex.dst_access_mask = VK_ACCESS_SHADER_READ_BIT;
+	barrier_faces_to_vertex.src_stage_mask  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	barrier_faces_to_vertex.dst_stage_mask  = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+	command_buffer.buffer_memory_barrier(faces, 0, faces.get_size(), barrier_faces_to_vertex);
+
+	vkb::BufferMemoryBarrier barrier_draw_to_indirect;
+	barrier_draw_to_indirect.src_access_mask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier_draw_to_indirect.dst_access_mask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	barrier_draw_to_indirect.src_stage_mask  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	barrier_draw_to_indirect.dst_stage_mask  = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+	command_buffer.buffer_memory_barrier(draw, 0, draw.get_size(), barrier_draw_to_indirect);
+}
@@ -0,0 +1,54 @@
+/* Copyright (c) 2019, Lachlan Deakin
+*
+* SPDX-License-Identifier: Apache-2.0
+*
+* Licensed under the Apache License, Version 2.0 the "License";
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#pragma once
+
+#include "core/shader_module.h"
+
+#include "volume_component.h"
+
+namespace vkb
+{
+class RenderContext;
+class CommandBuffer;
+}        // namespace vkb
+
+/**
+ * @brief Extracts the boundary faces of the occupied bricks of the first distance map into an indirect draw, see proxy_geometry.comp
+ *
+ * The ray caster rasterises the faces instead of the bounding cube, so rays start at the first occupied brick and pixels which miss every occupied brick are never shaded.
+ */
+class ComputeProxyGeometry
+{
+  public:
+	ComputeProxyGeometry(vkb::RenderContext &render_context);
+
+	virtual ~ComputeProxyGeometry() = default;
+
+	// The first distance map must be in the shader read only layout and is left in it
+	void compute(vkb::CommandBuffer &command_buffer, Volume &volume);
+
+  private:
+	vkb::RenderContext &render_context;
+
+	vkb::ShaderSource compute_shader;
+
+	vkb::ImageMemoryBarrier memory_barrier_read_only_to_compute{};
+	vkb::ImageMemoryBarrier memory_barrier_to_compute{};
+	vkb::ImageMemoryBarrier memory_barrier_write_to_read{};
+	vkb::ImageMemoryBarrier memory_barrier_compute_to_fragment{};
+};
@@ -0,0 +1,116 @@
+/* Copyright (c) 2019, Lachlan Deakin
+*
+* SPDX-License-Identifier: Apache-2.0
+*
+* Licensed under the Apache License, Version 2.0 the "License";
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "compute_reduction.h"
+
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include "common/vk_common.h"
+#include "rendering/render_context.h"
+
+namespace
+{
+// Inverse of reduction_order() in reduction.glsl
+float unorder(uint32_t ordered)
+{
+	uint32_t bits = (ordered & 0x80000000u) != 0 ? ordered & 0x7fffffffu : ~ordered;
+	float    value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+}        // namespace
+
+ComputeReduction::ComputeReduction(vkb::RenderContext &render_context, size_t n_slots)
+{
+	slots.reserve(n_slots);
+	for (size_t i = 0; i < n_slots; ++i)
+	{
+		slots.emplace_back(render_context.get_device(), sizeof(Slot),
+		                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU);
+	}
+	current = n_slots - 1;
+}
+
+void ComputeReduction::begin(vkb::CommandBuffer &command_buffer)
+{
+	current      = (current + 1) % slots.size();
+	auto &buffer = slots[current];
+
+	Slot initial{};
+	initial.min_value = ~0u;
+	initial.aabb_min  = glm::ivec4(std::numeric_limits<int32_t>::max());
+	initial.aabb_max  = glm::ivec4(std::numeric_limits<int32_t>::min());
+	vkCmdUpdateBuffer(command_buffer.get_handle(), buffer.get_handle(), 0, sizeof(Slot), &initial);
+
+	vkb::BufferMemoryBarrier barrier;
+	barrier.src_access_mask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dst_access_mask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.src_stage_mask  = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	barrier.dst_stage_mask  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	command_buffer.buffer_memory_barrier(buffer, 0, buffer.get_size(), barrier);
+}
+
+void ComputeReduction::bind(vkb::CommandBuffer &command_buffer, uint32_t set, uint32_t binding)
+{
+	auto &buffer = slots[current];
+	command_buffer.bind_buffer(buffer, 0, buffer.get_size(), set, binding, 0);
+}
+
+void ComputeReduction::end(vkb::CommandBuffer &command_buffer)
+{
+	auto &buffer = slots[current];
+
+	vkb::BufferMemoryBarrier barrier;
+	barrier.src_access_mask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dst_access_mask = VK_ACCESS_HOST_READ_BIT;
+	barrier.src_stage_mask  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	barrier.dst_stage_mask  = VK_PIPELINE_STAGE_HOST_BIT;
+	command_buffer.buffer_memory_barrier(buffer, 0, buffer.get_size(), barrier);
+}
+
+ComputeReduction::Result ComputeReduction::get_result(size_t age)
+{
+	if (age >= slots.size())
+	{
+		throw std::runtime_error("Reduction results are only kept for " + std::to_string(slots.size()) + " passes");
+	}
+	auto &buffer = slots[(current + slots.size() - age) % slots.size()];
+
+	Slot slot;
+	std::memcpy(&slot, buffer.map(), sizeof(Slot));
+	buffer.unmap();
+
+	Result result;
+	result.sum = (static_cast<uint64_t>(slot.sum_hi) << 32) | slot.sum_lo;
+	if (slot.min_value <= slot.max_value)
+	{
+		result.min = unorder(slot.min_value);
+		result.max = unorder(slot.max_value);
+	}
+	else
+	{
+		result.min = std::numeric_limits<float>::infinity();
+		result.max = -std::numeric_limits<float>::infinity();
+	}
+	result.aabb_min  = glm::ivec3(slot.aabb_min);
+	result.aabb_max  = glm::ivec3(slot.aabb_max);
+	result.histogram = slot.histogram;
+	return result;
+}
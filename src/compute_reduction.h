@@ -0,0 +1,83 @@
+/* Copyright (c) 2019, Lachlan Deakin
+*
+* SPDX-License-Identifier: Apache-2.0
+*
+* Licensed under the Apache License, Version 2.0 the "License";
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "core/buffer.h"
+
+namespace vkb
+{
+class RenderContext;
+class CommandBuffer;
+}        // namespace vkb
+
+/**
+ * @brief Results of the single pass reductions in reduction.glsl
+ *
+ * Shaders bind the current slot with bind() between begin() and end(), every workgroup of every dispatch in between reduces into it.
+ * Slots are small persistent host visible buffers used round robin, so a result can be read a frame later without stalling the GPU.
+ */
+class ComputeReduction
+{
+  public:
+	struct Result
+	{
+		uint64_t                  sum;
+		float                     min;
+		float                     max;
+		glm::ivec3                aabb_min;
+		glm::ivec3                aabb_max;        // inclusive, less than aabb_min if nothing was reduced
+		std::array<uint32_t, 256> histogram;
+	};
+
+	ComputeReduction(vkb::RenderContext &render_context, size_t n_slots = 2);
+
+	virtual ~ComputeReduction() = default;
+
+	// Resets the next slot
+	void begin(vkb::CommandBuffer &command_buffer);
+
+	void bind(vkb::CommandBuffer &command_buffer, uint32_t set, uint32_t binding);
+
+	// Makes the slot visible to the host once the command buffer completes
+	void end(vkb::CommandBuffer &command_buffer);
+
+	// Reads the slot of the reduction age begin() calls ago, its command buffer must have completed
+	Result get_result(size_t age = 0);
+
+  private:
+	// Layout of reductionBuffer in reduction.glsl
+	struct Slot
+	{
+		uint32_t                  sum_lo;
+		uint32_t                  sum_hi;
+		uint32_t                  min_value;
+		uint32_t                  max_value;
+		glm::ivec4                aabb_min;
+		glm::ivec4                aabb_max;
+		std::array<uint32_t, 256> histogram;
+	};
+
+	std::vector<vkb::core::Buffer> slots;
+
+	size_t current = 0;
+};
@@ -0,0 +1,123 @@
+/* Copyright (c) 2019, Lachlan Deakin
+*
+* SPDX-License-Identifier: Apache-2.0
+*
+* Licensed under the Apache License, Version 2.0 the "License";
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "compute_volume_sweep.h"
+
+#include "common/vk_common.h"
+#include "platform/filesystem.h"
+#include "rendering/render_context.h"
+
+auto rndUp = [](int x, int y) { return (x + y - 1) / y; };
+
+ComputeVolumeSweep::ComputeVolumeSweep(vkb::RenderContext &render_context) :
+    render_context(render_context),
+    compute_shader("volume_sweep.comp")
+{
+	// Build all shaders upfront
+	vkb::ShaderVariant variant;
+	variant.add_define("PRECOMPUTED_GRADIENT");
+	vkb::ShaderVariant variant_write;
+	variant_write.add_define("PRECOMPUTED_GRADIENT");
+	variant_write.add_define("WRITE_GRADIENT");
+	auto &resource_cache = render_context.get_device().get_resource_cache();
+	resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader);
+	resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader, variant);
+	resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader, variant_write);
+
+	// Memory barriers
+	memory_barrier_to_clear.old_layout      = VK_IMAGE_LAYOUT_UNDEFINED;
+	memory_barrier_to_clear.new_layout      = VK_IMAGE_LAYOUT_GENERAL;
+	memory_barrier_to_clear.src_access_mask = 0;
+	memory_barrier_to_clear.dst_access_mask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	memory_barrier_to_clear.src_stage_mask  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	memory_barrier_to_clear.dst_stage_mask  = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+	memory_barrier_clear_to_compute.old_layout      = VK_IMAGE_LAYOUT_GENERAL;
+	memory_barrier_clear_to_compute.new_layout      = VK_IMAGE_LAYOUT_GENERAL;
+	memory_barrier_clear_to_compute.src_access_mask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	memory_barrier_clear_to_compute.dst_access_mask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT;
+	memory_barrier_clear_to_compute.src_stage_mask  = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	memory_barrier_clear_to_compute.dst_stage_mask  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+}
+
+void ComputeVolumeSweep::compute(vkb::CommandBuffer &command_buffer, Volume &volume, vkb::BufferAllocation &transfer_function_uniform, const Volume::Image &occupancy_map,
+                                 ComputeReduction *occupied_voxel_count)
+{
+	auto &volume_tex = volume.get_volume();
+
+	// Blocks span several workgroups, so the sweep only marks occupied blocks
+	VkClearColorValue       empty{};
+	VkImageSubresourceRange range{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+	empty.uint32[0] = 255;
+	command_buffer.image_memory_barrier(*occupancy_map.image_view, memory_barrier_to_clear);
+	vkCmdClearColorImage(command_buffer.get_handle(), occupancy_map.image->get_handle(), VK_IMAGE_LAYOUT_GENERAL, &empty, 1, &range);
+	command_buffer.image_memory_barrier(*occupancy_map.image_view, memory_barrier_clear_to_compute);
+
+	// Compute block size
+	auto       extent        = occupancy_map.image->get_extent();
+	auto       volume_extent = volume_tex.image->get_extent();
+	glm::ivec3 block_size(
+	    rndUp(volume_extent.width, extent.width),
+	    rndUp(volume_extent.height, extent.height),
+	    rndUp(volume_extent.depth, extent.depth));
+
+	// The gradient map only depends on the volume and its window, it is left alone if the transfer function ignores the gradient
+	bool               write_gradient = volume.options.use_precomputed_gradient && volume.get_transfer_function_uniform().use_gradient && volume.is_gradient_outdated();
+	vkb::ShaderVariant variant;
+	if (volume.options.use_precomputed_gradient)
+	{
+		variant.add_define("PRECOMPUTED_GRADIENT");
+	}
+	if (write_gradient)
+	{
+		variant.add_define("WRITE_GRADIENT");
+	}
+	if (occupied_voxel_count)
+	{
+		variant.add_define("COUNT_OCCUPIED_VOXELS");
+	}
+	volume.add_shader_defines(variant);
+
+	auto &resource_cache  = command_buffer.get_device().get_resource_cache();
+	auto &shader_module   = resource_cache.request_shader_module(VK_SHADER_STAGE_COMPUTE_BIT, compute_shader, variant);
+	auto &pipeline_layout = resource_cache.request_pipeline_layout({&shader_module});
+
+	// Bind pipeline layout, images and buffers
+	command_buffer.bind_pipeline_layout(pipeline_layout);
+	command_buffer.bind_input(*volume_tex.image_view, 0, 0, 0);
+	command_buffer.bind_buffer(transfer_function_uniform.get_buffer(), transfer_function_uniform.get_offset(), transfer_function_uniform.get_size(), 0, 1, 0);
+	command_buffer.bind_image(*volume.get_transfer_function().image_view, *volume.get_transfer_function().sampler, 0, 2, 0);
+	if (write_gradient)
+	{
+		command_buffer.bind_input(*volume.get_gradient().image_view, 0, 3, 0);
+		volume.set_gradient_updated();
+	}
+	command_buffer.bind_input(*occupancy_map.image_view, 0, 4, 0);
+	if (occupied_voxel_count)
+	{
+		occupied_voxel_count->begin(command_buffer);
+		occupied_voxel_count->bind(command_buffer, 0, 5);
+	}
+
+	command_buffer.push_constants(glm::ivec4(block_size, 0));
+	command_buffer.dispatch(rndUp(volume_extent.width, 8), rndUp(volume_extent.height, 8), rndUp(volume_extent.depth, 8));
+
+	if (occupied_voxel_count)
+	{
+		occupied_voxel_count->end(command_buffer);
+	}
+}
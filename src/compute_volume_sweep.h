@@ -0,0 +1,55 @@
+/* Copyright (c) 2019, Lachlan Deakin
+*
+* SPDX-License-Identifier: Apache-2.0
+*
+* Licensed under the Apache License, Version 2.0 the "License";
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#pragma once
+
+#include "core/shader_module.h"
+
+#include "compute_reduction.h"
+#include "volume_component.h"
+
+namespace vkb
+{
+class RenderContext;
+class CommandBuffer;
+}        // namespace vkb
+
+/**
+ * @brief Classifies every voxel in a single read of the volume, see volume_sweep.comp
+ *
+ * Writes the occupancy map, the gradient map if the volume uses a precomputed gradient which is outdated (see Volume::is_gradient_outdated()) and the transfer function uses the gradient,
+ * and optionally the occupied voxel count as the sum of a reduction.
+ */
+class ComputeVolumeSweep
+{
+  public:
+	ComputeVolumeSweep(vkb::RenderContext &render_context);
+
+	virtual ~ComputeVolumeSweep() = default;
+
+	// The volume and the gradient map must be in the general layout, the occupancy map is discarded and left in the general layout
+	void compute(vkb::CommandBuffer &command_buffer, Volume &volume, vkb::BufferAllocation &transfer_function_uniform, const Volume::Image &occupancy_map,
+	             ComputeReduction *occupied_voxel_count = nullptr);
+
+  private:
+	vkb::RenderContext &render_context;
+
+	vkb::ShaderSource compute_shader;
+
+	vkb::ImageMemoryBarrier memory_barrier_to_clear{};
+	vkb::ImageMemoryBarrier memory_barrier_clear_to_compute{};
+};
@@ -0,0 +1,172 @@
+/* Copyright (c) 2019, Lachlan Deakin
+*
+* SPDX-License-Identifier: Apache-2.0
+*
+* Licensed under the Apache License, Version 2.0 the "License";
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "derived_data_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <sys/stat.h>
+
+#include "mapped_file.h"
+
+#undef min
+#undef max
+
+namespace
+{
+const char     magic[8] = {'V', 'K', 'V', 'C', 'A', 'C', 'H', 'E'};
+const uint32_t version  = 1;
+
+// Content hash samples, enough to notice a rewritten file without reading all of it
+const size_t hash_samples     = 16;
+const size_t hash_sample_size = 64 << 10;
+
+struct EntryHeader
+{
+	char     magic[8];
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t key;
+	uint64_t size;
+};
+
+// FNV-1a
+uint64_t hash_bytes(const void *data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+	const uint8_t *bytes = static_cast<const uint8_t *>(data);
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+std::string file_name(const std::string &path)
+{
+	size_t separator = path.find_last_of("/\\");
+	return separator == std::string::npos ? path : path.substr(separator + 1);
+}
+}        // namespace
+
+DerivedDataCache::DerivedDataCache(std::string directory /* = "" */) :
+    directory(directory)
+{}
+
+const uint8_t *DerivedDataCache::Entry::data() const
+{
+	return static_cast<const uint8_t *>(region.get_address()) + sizeof(EntryHeader);
+}
+
+size_t DerivedDataCache::Entry::size() const
+{
+	return region.get_size() - sizeof(EntryHeader);
+}
+
+uint64_t DerivedDataCache::get_file_key(const std::string &filename_data) const
+{
+	struct stat file_stat;
+	if (stat(filename_data.c_str(), &file_stat) != 0)
+	{
+		throw std::runtime_error("Failed to open data file");
+	}
+	uint64_t file_size = static_cast<uint64_t>(file_stat.st_size);
+	int64_t  mtime     = static_cast<int64_t>(file_stat.st_mtime);
+
+	uint64_t hash = hash_bytes(&file_size, sizeof(file_size));
+	hash          = hash_bytes(&mtime, sizeof(mtime), hash);
+	if (file_size > 0)
+	{
+		boost::interprocess::file_mapping  mapping;
+		boost::interprocess::mapped_region region = map_file(filename_data, mapping);
+		const uint8_t *                    base   = static_cast<const uint8_t *>(region.get_address());
+		size_t                             sample = std::min<size_t>(hash_sample_size, region.get_size());
+		for (size_t i = 0; i < hash_samples; ++i)
+		{
+			size_t offset = (region.get_size() - sample) / (hash_samples - 1) * i;
+			hash          = hash_bytes(base + offset, sample, hash);
+		}
+	}
+	return hash;
+}
+
+uint64_t DerivedDataCache::get_key(uint64_t file_key, const std::string &parameters) const
+{
+	return hash_bytes(parameters.data(), parameters.size(), file_key);
+}
+
+std::unique_ptr<DerivedDataCache::Entry> DerivedDataCache::load(const std::string &filename_data, const std::string &name, uint64_t key) const
+{
+	std::string path = get_path(filename_data, name);
+	if (!std::ifstream(path).good())
+	{
+		return nullptr;
+	}
+
+	std::unique_ptr<Entry> entry(new Entry);
+	entry->region = map_file(path, entry->mapping);
+
+	EntryHeader header;
+	if (entry->region.get_size() < sizeof(header))
+	{
+		return nullptr;
+	}
+	std::memcpy(&header, entry->region.get_address(), sizeof(header));
+	if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version || header.key != key || header.size != entry->size())
+	{
+		return nullptr;
+	}
+	return entry;
+}
+
+void DerivedDataCache::store(const std::string &filename_data, const std::string &name, uint64_t key, const void *data, size_t size) const
+{
+	EntryHeader header{};
+	std::memcpy(header.magic, magic, sizeof(magic));
+	header.version = version;
+	header.key     = key;
+	header.size    = size;
+
+	std::string path     = get_path(filename_data, name);
+	std::string path_tmp = path + ".tmp";
+	{
+		std::ofstream file(path_tmp, std::ios::binary);
+		file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		file.write(static_cast<const char *>(data), size);
+		if (!file)
+		{
+			std::remove(path_tmp.c_str());
+			throw std::runtime_error("Failed to write cache file " + path);
+		}
+	}
+
+	std::remove(path.c_str());
+	if (std::rename(path_tmp.c_str(), path.c_str()) != 0)
+	{
+		std::remove(path_tmp.c_str());
+		throw std::runtime_error("Failed to write cache file " + path);
+	}
+}
+
+std::string DerivedDataCache::get_path(const std::string &filename_data, const std::string &name) const
+{
+	std::string base = directory.empty() ? filename_data : directory + "/" + file_name(filename_data);
+	return base + "." + name + ".cache";
+}
@@ -0,0 +1,71 @@
+/* Copyright (c) 2019, Lachlan Deakin
+*
+* SPDX-License-Identifier: Apache-2.0
+*
+* Licensed under the Apache License, Version 2.0 the "License";
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+/**
+ * @brief On-disk cache of data derived from a volume, such as the gradient map and histogram
+ *
+ * Each entry is a file named after the data file and the entry, stored next to the data file or in a cache directory.
+ * Entries are keyed by the data file size, modification time, a hash of sampled file content and the parameters the derived data depends on,
+ * an entry with a different key is stale and is replaced by the next store().
+ */
+class DerivedDataCache
+{
+  public:
+	// An empty directory stores entries next to the data file
+	explicit DerivedDataCache(std::string directory = "");
+
+	// A memory mapped cache entry
+	class Entry
+	{
+	  public:
+		const uint8_t *data() const;
+		size_t         size() const;
+
+	  private:
+		friend class DerivedDataCache;
+
+		boost::interprocess::file_mapping  mapping;
+		boost::interprocess::mapped_region region;
+	};
+
+	// Hashes the data file size, modification time and sampled content, this reads the data file so compute it once per volume
+	uint64_t get_file_key(const std::string &filename_data) const;
+
+	// Combines a file key with the parameters the derived data depends on
+	uint64_t get_key(uint64_t file_key, const std::string &parameters) const;
+
+	// Maps an entry, returns nullptr if there is no entry with this key
+	std::unique_ptr<Entry> load(const std::string &filename_data, const std::string &name, uint64_t key) const;
+
+	// Replaces an entry, the file is written under a temporary name and renamed so readers never see a partial entry
+	void store(const std::string &filename_data, const std::string &name, uint64_t key, const void *data, size_t size) const;
+
+  private:
+	std::string get_path(const std::string &filename_data, const std::string &name) const;
+
+	std::string directory;
+};
@@ -0,0 +1,172 @@
+/* Copyright (c) 2019, Lachlan Deakin
+*
+* SPDX-License-Identifier: Apache-2.0
+*
+* Licensed under the Apache License, Version 2.0 the "License";
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "distance_map_cpu.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "parallel_for.h"
+
+namespace
+{
+// Scanlines per thread
+const size_t grain = 64;
+
+// "Transformation 1" along x, direction 0 searches both ways, otherwise only towards +x or -x
+void transform_x(const uint8_t *src, uint8_t *dst, VkExtent3D extent, int direction)
+{
+	size_t width = extent.width;
+	parallel_for(0, static_cast<size_t>(extent.height) * extent.depth, grain, [&](size_t begin, size_t end) {
+		for (size_t row = begin; row < end; ++row)
+		{
+			const uint8_t *src_row = src + row * width;
+			uint8_t *      dst_row = dst + row * width;
+			if (direction <= 0)
+			{
+				// Forward
+				uint32_t d = src_row[0];
+				dst_row[0] = static_cast<uint8_t>(d);
+				for (size_t x = 1; x < width; ++x)
+				{
+					d          = std::min<uint32_t>(d + 1, src_row[x]);
+					dst_row[x] = static_cast<uint8_t>(d);
+				}
+			}
+			if (direction >= 0)
+			{
+				// Backward, continues from the forward pass if searching both ways
+				const uint8_t *in = direction == 0 ? dst_row : src_row;
+				uint32_t       d  = in[width - 1];
+				dst_row[width - 1] = static_cast<uint8_t>(d);
+				for (size_t x = width - 1; x-- > 0;)
+				{
+					d          = std::min<uint32_t>(d + 1, in[x]);
+					dst_row[x] = static_cast<uint8_t>(d);
+				}
+			}
+		}
+	});
+}
+
+// "Transformations 2 and 3", the minimum of max(n, D(i + n)) over a scanline of length count, searching outwards from i while n can lower the distance
+inline uint8_t search(const uint8_t *scanline, int i, int count, size_t stride, int direction)
+{
+	uint32_t d = scanline[i * stride];
+	for (int n = 1; n < static_cast<int>(d); ++n)
+	{
+		if (direction <= 0 && i >= n)
+		{
+			d = std::min<uint32_t>(d, std::max<uint32_t>(n, scanline[(i - n) * stride]));
+		}
+		if (direction >= 0 && i + n < count)
+		{
+			d = std::min<uint32_t>(d, std::max<uint32_t>(n, scanline[(i + n) * stride]));
+		}
+	}
+	return static_cast<uint8_t>(d);
+}
+
+void transform_y(const uint8_t *src, uint8_t *dst, VkExtent3D extent, int direction)
+{
+	size_t width = extent.width, slice = static_cast<size_t>(extent.width) * extent.height;
+	parallel_for(0, extent.depth, 1, [&](size_t begin, size_t end) {
+		for (size_t z = begin; z < end; ++z)
+		{
+			for (uint32_t y = 0; y < extent.height; ++y)
+			{
+				for (size_t x = 0; x < width; ++x)
+				{
+					dst[z * slice + y * width + x] = search(src + z * slice + x, y, extent.height, width, direction);
+				}
+			}
+		}
+	});
+}
+
+void transform_z(const uint8_t *src, uint8_t *dst, VkExtent3D extent, int direction)
+{
+	size_t width = extent.width, slice = static_cast<size_t>(extent.width) * extent.height;
+	parallel_for(0, extent.height, 1, [&](size_t begin, size_t end) {
+		for (size_t y = begin; y < end; ++y)
+		{
+			for (uint32_t z = 0; z < extent.depth; ++z)
+			{
+				for (size_t x = 0; x < width; ++x)
+				{
+					dst[z * slice + y * width + x] = search(src + y * width + x, z, extent.depth, slice, direction);
+				}
+			}
+		}
+	});
+}
+}        // namespace
+
+void compute_distance_map_cpu(const uint8_t *occupancy_map, VkExtent3D extent, uint8_t *distance_map)
+{
+	std::vector<uint8_t> swap(static_cast<size_t>(extent.width) * extent.height * extent.depth);
+	transform_x(occupancy_map, distance_map, extent, 0);
+	transform_y(distance_map, swap.data(), extent, 0);
+	transform_z(swap.data(), distance_map, extent, 0);
+}
+
+void compute_distance_map_anisotropic_cpu(const uint8_t *occupancy_map, VkExtent3D extent, const std::array<uint8_t *, 8> &distance_maps)
+{
+	size_t               size = static_cast<size_t>(extent.width) * extent.height * extent.depth;
+	std::vector<uint8_t> swap_x(size), swap_y(size);
+	for (int i = 0; i < 8; i += 2)
+	{
+		int direction_x = i & 4 ? -1 : 1;
+		int direction_y = i & 2 ? -1 : 1;
+		if ((i & 2) == 0)
+		{
+			transform_x(occupancy_map, swap_x.data(), extent, direction_x);
+		}
+		transform_y(swap_x.data(), swap_y.data(), extent, direction_y);
+		transform_z(swap_y.data(), distance_maps[i], extent, 1);
+		transform_z(swap_y.data(), distance_maps[i + 1], extent, -1);
+	}
+}
+
+void compute_coarse_occupancy_cpu(const uint8_t *distance_map, VkExtent3D extent, uint8_t *occupancy_coarse)
+{
+	VkExtent3D coarse = {(extent.width + 1) / 2, (extent.height + 1) / 2, (extent.depth + 1) / 2};
+	parallel_for(0, coarse.depth, 1, [&](size_t begin, size_t end) {
+		for (size_t z = begin; z < end; ++z)
+		{
+			for (uint32_t y = 0; y < coarse.height; ++y)
+			{
+				for (uint32_t x = 0; x < coarse.width; ++x)
+				{
+					// Finer blocks past the edge are clamped like the image loads of the shader
+					uint8_t occupancy = 255;
+					for (int i = 0; i < 8; ++i)
+					{
+						size_t fx = std::min<size_t>(2 * x + (i & 1), extent.width - 1);
+						size_t fy = std::min<size_t>(2 * y + ((i >> 1) & 1), extent.height - 1);
+						size_t fz = std::min<size_t>(2 * z + (i >> 2), extent.depth - 1);
+						if (distance_map[(fz * extent.height + fy) * extent.width + fx] == 0)
+						{
+							occupancy = 0;
+						}
+					}
+					occupancy_coarse[(z * coarse.height + y) * coarse.width + x] = occupancy;
+				}
+			}
+		}
+	});
+}
@@ -0,0 +1,47 @@
+/* Copyright (c) 2019, Lachlan Deakin
+*
+* SPDX-License-Identifier: Apache-2.0
+*
+* Licensed under the Apache License, Version 2.0 the "License";
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+/**
+ * @brief Chebyshev distance transform of an occupancy map on the CPU, a bit-exact reference for distance_map.comp
+ *
+ * Maps are indexed like the images (x fastest, then y, then z), occupied blocks are 0 and empty blocks 255.
+ * The three stages of distance_map.comp are run in turn, each split by scanline across the workers of ThreadPool::get().
+ * The output is compared against the GPU distance maps by VolumeRender::validate_distance_maps().
+ */
+void compute_distance_map_cpu(const uint8_t *occupancy_map, VkExtent3D extent, uint8_t *distance_map);
+
+/**
+ * @brief Anisotropic Chebyshev distance transform on the CPU, a bit-exact reference for distance_map_anisotropic.comp
+ *
+ * Each of the 8 distance maps only searches one octant, in the order used by ComputeDistanceMap:
+ * bits 2, 1 and 0 of the index select the -x, -y and -z directions respectively, so distance_maps[0] is the +x+y+z octant.
+ */
+void compute_distance_map_anisotropic_cpu(const uint8_t *occupancy_map, VkExtent3D extent, const std::array<uint8_t *, 8> &distance_maps);
+
+/**
+ * @brief Occupancy of the next coarser level of a hierarchical distance map on the CPU, a bit-exact reference for distance_map_downsample.comp
+ *
+ * A coarse block is occupied if any of its 2x2x2 finer blocks are, the coarse extent is half of extent rounded up.
+ */
+void compute_coarse_occupancy_cpu(const uint8_t *distance_map, VkExtent3D extent, uint8_t *occupancy_coarse);
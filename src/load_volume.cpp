@@ -19,14 +19,32 @@
 
 #include <algorithm>
 #include <fstream>
+#include <limits>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 
-#include <boost/endian/conversion.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#if defined(__linux__)
+#	include <cerrno>
+#	include <cstdlib>
+#	include <fcntl.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#	define LOAD_VOLUME_DIRECT_IO
+#endif
 
 #include <glm/gtx/transform.hpp>
 
+#include "bricked_volume.h"
+#include "compressed_volume.h"
+#include "mapped_file.h"
+#include "parallel_for.h"
+
+#include "volume_conversion.h"
+
 #undef min
 #undef max
 
@@ -45,9 +63,10 @@ LoadVolume::Header LoadVolume::load_header(std::string filename_header)
 	/*
 832 832 494 # extents
 0.001 0.001 0.001 # voxel size
-400.0 2538.0 # normalisation range
+400.0 2538.0 # normalisation range, or auto [lower upper] to find it from the data between percentiles
 uint16_t little # data type and endianness (big or little)
 1 0 0 90 # rotation axis and angle (degrees)
+raw # optional data file format (raw, bricked or compressed <codec>)
   */
 
 	// FIXME: Error/sanity checking
@@ -65,7 +84,26 @@ uint16_t little # data type and endianness (big or little)
 	// Normalisation range
 	std::getline(file, line);
 	ss = std::istringstream(line);
-	ss >> header.normalisation_range.x >> header.normalisation_range.y;
+	std::string range_mode;
+	ss >> range_mode;
+	if (range_mode == "auto")
+	{
+		header.auto_range = true;
+		std::string lower, upper;
+		if (ss >> lower >> upper && lower[0] != '#')
+		{
+			header.percentiles = glm::vec2(std::stof(lower), std::stof(upper));
+		}
+		if (header.percentiles.x < 0.0f || header.percentiles.y > 100.0f || header.percentiles.x >= header.percentiles.y)
+		{
+			throw std::runtime_error("Invalid normalisation range percentiles");
+		}
+	}
+	else
+	{
+		ss = std::istringstream(line);
+		ss >> header.normalisation_range.x >> header.normalisation_range.y;
+	}
 
 	// Data type and endianness
 	std::getline(file, line);
@@ -82,91 +120,487 @@ uint16_t little # data type and endianness (big or little)
 	glm::vec3 physical_size = header.voxel_size * glm::vec3(header.extent.width, header.extent.height, header.extent.depth);
 	header.image_transform  = glm::rotate(glm::radians(angle_axis.w), glm::vec3(angle_axis.xyz)) * glm::scale(physical_size);
 
+	// Data file format, raw if omitted
+	header.format = "raw";
+	if (std::getline(file, line))
+	{
+		ss = std::istringstream(line);
+		std::string format, codec;
+		if (ss >> format && format[0] != '#')
+		{
+			header.format = format;
+			if (ss >> codec && codec[0] != '#')
+			{
+				header.codec = codec;
+			}
+		}
+	}
+
 	return header;
 }
 
+std::vector<std::string> LoadVolume::load_header_lines(std::string filename_header)
+{
+	std::ifstream file(filename_header);
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Failed to open header file");
+	}
+
+	std::vector<std::string> lines(5);
+	for (auto &line : lines)
+	{
+		if (!std::getline(file, line))
+		{
+			throw std::runtime_error("Header file is incomplete");
+		}
+	}
+	return lines;
+}
+
 std::vector<uint8_t> LoadVolume::load_data(std::string filename_data, const Header &header)
 {
+	size_t               n_voxels = static_cast<size_t>(header.extent.width) * static_cast<size_t>(header.extent.height) * static_cast<size_t>(header.extent.depth);
+	std::vector<uint8_t> volume_data(n_voxels);
+	open(filename_data, header, ReaderType::Stream)->read(0, n_voxels, volume_data.data());
+	return volume_data;
+}
+
+size_t LoadVolume::get_format_size(VkFormat format)
+{
+	switch (format)
+	{
+		case VK_FORMAT_R16_UNORM:
+		case VK_FORMAT_R16_SNORM:
+			return sizeof(uint16_t);
+		case VK_FORMAT_R8_UNORM:
+		default:
+			return sizeof(uint8_t);
+	}
+}
+
+std::unique_ptr<LoadVolume::Reader> LoadVolume::open(std::string filename_data, const Header &header, ReaderType type /* = ReaderType::MemoryMapped */, bool native_16bit /* = false */)
+{
+	if (header.auto_range)
+	{
+		Header resolved = header;
+		resolve_auto_range(filename_data, resolved, type);
+		return open(filename_data, resolved, type, native_16bit);
+	}
+
 	if (header.type == "uint8_t")
 	{
-		return load_data_impl<uint8_t>(filename_data, header);
+		return open_impl<uint8_t>(filename_data, header, type, native_16bit);
 	}
 	else if (header.type == "int8_t")
 	{
-		return load_data_impl<int8_t>(filename_data, header);
+		return open_impl<int8_t>(filename_data, header, type, native_16bit);
 	}
 	else if (header.type == "uint16_t")
 	{
-		return load_data_impl<uint16_t>(filename_data, header);
+		return open_impl<uint16_t>(filename_data, header, type, native_16bit);
 	}
 	else if (header.type == "int16_t")
 	{
-		return load_data_impl<int16_t>(filename_data, header);
+		return open_impl<int16_t>(filename_data, header, type, native_16bit);
+	}
+	else if (header.type == "uint32_t")
+	{
+		return open_impl<uint32_t>(filename_data, header, type, native_16bit);
+	}
+	else if (header.type == "int32_t")
+	{
+		return open_impl<int32_t>(filename_data, header, type, native_16bit);
+	}
+	else if (header.type == "float")
+	{
+		return open_impl<float>(filename_data, header, type, native_16bit);
+	}
+	else
+	{
+		throw std::runtime_error("unsupported image data type");
+	}
+}
+
+void LoadVolume::resolve_auto_range(std::string filename_data, Header &header, ReaderType type /* = ReaderType::MemoryMapped */)
+{
+	if (!header.auto_range)
+	{
+		return;
+	}
+	if (header.format != "raw")
+	{
+		throw std::runtime_error("auto normalisation range requires a raw data file, vconvert resolves it when converting");
+	}
+	if (type == ReaderType::Direct)
+	{
+		// Finding the range takes passes of its own before the conversion, which would defeat the single uncached pass of the direct reader
+		throw std::runtime_error("auto normalisation range is not supported by the direct reader, set the range in the header or resolve it with vconvert");
+	}
+
+	if (header.type == "uint8_t")
+	{
+		header.normalisation_range = find_range<uint8_t>(filename_data, header);
+	}
+	else if (header.type == "int8_t")
+	{
+		header.normalisation_range = find_range<int8_t>(filename_data, header);
+	}
+	else if (header.type == "uint16_t")
+	{
+		header.normalisation_range = find_range<uint16_t>(filename_data, header);
+	}
+	else if (header.type == "int16_t")
+	{
+		header.normalisation_range = find_range<int16_t>(filename_data, header);
+	}
+	else if (header.type == "uint32_t")
+	{
+		header.normalisation_range = find_range<uint32_t>(filename_data, header);
+	}
+	else if (header.type == "int32_t")
+	{
+		header.normalisation_range = find_range<int32_t>(filename_data, header);
+	}
+	else if (header.type == "float")
+	{
+		header.normalisation_range = find_range<float>(filename_data, header);
 	}
 	else
 	{
 		throw std::runtime_error("unsupported image data type");
 	}
+	header.auto_range = false;
 }
 
+namespace
+{
+size_t expected_file_size(const LoadVolume::Header &header, size_t voxel_size)
+{
+	return static_cast<size_t>(header.extent.width) * static_cast<size_t>(header.extent.height) * static_cast<size_t>(header.extent.depth) * voxel_size;
+}
+
+// Reads through std::ifstream in bounded chunks
 template <typename T>
-std::vector<uint8_t> LoadVolume::load_data_impl(std::string filename_data, const Header &header)
+class StreamReader : public LoadVolume::Reader
 {
-	size_t         n_voxels = static_cast<size_t>(header.extent.width) * static_cast<size_t>(header.extent.height) * static_cast<size_t>(header.extent.depth);
-	std::vector<T> image_data(n_voxels);
-	size_t         file_size = image_data.size() * sizeof(T);
+  public:
+	StreamReader(std::string filename_data, const LoadVolume::Header &header, bool native_16bit) :
+	    file(filename_data, std::ios::binary),
+	    convert(header.normalisation_range.x, header.normalisation_range.y, header.endianness == "big", LoadVolume::get_format<T>(native_16bit) == VK_FORMAT_R8_UNORM)
+	{
+		format = LoadVolume::get_format<T>(native_16bit);
+		if (!file.is_open())
+		{
+			throw std::runtime_error("Failed to open data file");
+		}
+		// Get file size
+		file.seekg(0, std::ios::end);
+		size_t file_size_actual = file.tellg();
+		if (file_size_actual != expected_file_size(header, sizeof(T)))
+		{
+			throw std::runtime_error("File size does not match expected size for the given image format/dimensions");
+		}
+		file.seekg(0, std::ios::beg);
+	}
 
-	// Load volume into memory
-	std::ifstream file(filename_data, std::ios::binary);
-	if (!file.is_open())
+	virtual void read(size_t first_voxel, size_t n_voxels, uint8_t *dst) override
 	{
-		throw std::runtime_error("Failed to open data file");
+		const size_t chunk_voxels = std::max(size_t(1), size_t(1e8) / sizeof(T));        // 1e8 = 100MB
+		chunk.resize(std::min(n_voxels, chunk_voxels));
+
+		file.seekg(first_voxel * sizeof(T), std::ios::beg);
+		size_t voxels_left = n_voxels;
+		while (voxels_left > 0)
+		{
+			size_t voxels_read = std::min(voxels_left, chunk_voxels);
+			file.read(reinterpret_cast<char *>(chunk.data()), voxels_read * sizeof(T));
+			if (!file)
+			{
+				throw std::runtime_error("File error");
+			}
+			convert(chunk.data(), voxels_read, dst);
+			dst += voxels_read * convert.get_output_size();
+			voxels_left -= voxels_read;
+		}
+		file.clear();
 	}
-	// Get file size
-	file.seekg(0, std::ios::end);
-	size_t file_size_actual = file.tellg();
-	if (file_size_actual != file_size)
+
+  private:
+	std::ifstream      file;
+	VolumeConverter<T> convert;
+	std::vector<T>     chunk;
+};
+
+// Maps the whole file into the address space and converts directly from the mapping, the page cache is the only host copy
+template <typename T>
+class MemoryMappedReader : public LoadVolume::Reader
+{
+  public:
+	MemoryMappedReader(std::string filename_data, const LoadVolume::Header &header, bool native_16bit) :
+	    region(map_file(filename_data, mapping)),
+	    convert(header.normalisation_range.x, header.normalisation_range.y, header.endianness == "big", LoadVolume::get_format<T>(native_16bit) == VK_FORMAT_R8_UNORM)
 	{
-		throw std::runtime_error("File size does not match expected size for the given image format/dimensions");
+		format = LoadVolume::get_format<T>(native_16bit);
+		if (region.get_size() != expected_file_size(header, sizeof(T)))
+		{
+			throw std::runtime_error("File size does not match expected size for the given image format/dimensions");
+		}
+		region.advise(boost::interprocess::mapped_region::advice_sequential);
 	}
-	file.seekg(0, std::ios::beg);
 
-	// Read into memory
-	size_t byte_pos   = 0;
-	size_t bytes_left = file_size;
-	while (bytes_left > 0)
+	virtual void read(size_t first_voxel, size_t n_voxels, uint8_t *dst) override
 	{
-		size_t bytes_read = std::min(bytes_left, size_t(1e8));        // 1e8 = 100MB
-		file.read(reinterpret_cast<char *>(image_data.data()) + byte_pos, bytes_read);
-		if (!file)
+		const T *src = reinterpret_cast<const T *>(region.get_address()) + first_voxel;
+		convert(src, n_voxels, dst);
+	}
+
+	virtual void prefetch(size_t first_voxel, size_t n_voxels) override
+	{
+		prefetch_mapped_range(region, first_voxel * sizeof(T), (first_voxel + n_voxels) * sizeof(T));
+	}
+
+  private:
+	boost::interprocess::file_mapping  mapping;
+	boost::interprocess::mapped_region region;
+	VolumeConverter<T>                 convert;
+};
+
+#if defined(LOAD_VOLUME_DIRECT_IO)
+// A file opened with O_DIRECT, read in aligned blocks with one pread in flight per thread, so a single scan of a large file does not evict the page cache
+class DirectFile
+{
+  public:
+	static const size_t block_size = size_t(4) << 20;        // bytes per request, a multiple of any O_DIRECT alignment
+
+	// Returns nullptr if the file system does not support O_DIRECT, either at open or on the first aligned read
+	static std::unique_ptr<DirectFile> open(std::string filename_data, size_t expected_size)
+	{
+		int fd = ::open(filename_data.c_str(), O_RDONLY | O_DIRECT);
+		if (fd < 0)
+		{
+			if (errno == EINVAL)
+			{
+				return nullptr;
+			}
+			throw std::runtime_error("Failed to open data file");
+		}
+		std::unique_ptr<DirectFile> file(new DirectFile(fd));
+
+		struct stat file_stat;
+		if (fstat(fd, &file_stat) != 0 || static_cast<size_t>(file_stat.st_size) != expected_size)
+		{
+			throw std::runtime_error("File size does not match expected size for the given image format/dimensions");
+		}
+		file->file_size = static_cast<size_t>(file_stat.st_size);
+
+		long transfer_alignment = fpathconf(fd, _PC_REC_XFER_ALIGN);
+		file->alignment         = std::max<size_t>(4096, transfer_alignment > 0 ? static_cast<size_t>(transfer_alignment) : 0);
+		if (block_size % file->alignment != 0)
+		{
+			throw std::runtime_error("Unsupported direct I/O alignment");
+		}
+
+		// Some file systems accept O_DIRECT at open but reject the reads, probe with one aligned read
+		auto    buffer = file->allocate_buffer(file->alignment);
+		ssize_t result;
+		do
+		{
+			result = pread(fd, buffer.get(), file->alignment, 0);
+		} while (result < 0 && errno == EINTR);
+		if (result < 0)
 		{
+			if (errno == EINVAL)
+			{
+				return nullptr;
+			}
 			throw std::runtime_error("File error");
 		}
-		byte_pos += bytes_read;
-		bytes_left -= bytes_read;
+		return file;
 	}
-	file.clear();
 
-	// Change to machine endianness
-	bool big_endian = header.endianness == "big";
-	for (T &i : image_data)
+	~DirectFile()
 	{
-		if (big_endian)
+		::close(fd);
+	}
+
+	size_t get_size() const
+	{
+		return file_size;
+	}
+
+	/**
+	 * @brief Calls f(block, block_begin, block_bytes) for each block overlapping the byte range [byte_begin, byte_end) of the file
+	 *
+	 * Blocks are read in parallel, f is called from several threads at once and block is only valid for the duration of the call.
+	 */
+	template <typename F>
+	void for_each_block(size_t byte_begin, size_t byte_end, F &&f) const
+	{
+		if (byte_end <= byte_begin)
 		{
-			boost::endian::big_to_native_inplace(i);
+			return;
 		}
-		else
+		parallel_for(byte_begin / block_size, (byte_end + block_size - 1) / block_size, 1, [&](size_t begin, size_t end) {
+			auto buffer = allocate_buffer(block_size);
+			for (size_t block = begin; block < end; ++block)
+			{
+				size_t block_begin = block * block_size;
+				size_t block_bytes = std::min(block_size, file_size - block_begin);
+				read_block(buffer.get(), block_begin, block_bytes);
+				f(static_cast<const uint8_t *>(buffer.get()), block_begin, block_bytes);
+			}
+		});
+	}
+
+  private:
+	explicit DirectFile(int fd) :
+	    fd(fd)
+	{}
+
+	std::unique_ptr<uint8_t, decltype(&std::free)> allocate_buffer(size_t n_bytes) const
+	{
+		void *buffer = nullptr;
+		if (posix_memalign(&buffer, alignment, n_bytes) != 0)
 		{
-			boost::endian::little_to_native_inplace(i);
+			throw std::bad_alloc();
 		}
+		return std::unique_ptr<uint8_t, decltype(&std::free)>(static_cast<uint8_t *>(buffer), &std::free);
 	}
 
-	// Convert to uint8_t
-	auto                 min = header.normalisation_range.x;
-	auto                 max = header.normalisation_range.y;
-	std::vector<uint8_t> volume_data(n_voxels);
-	std::transform(image_data.begin(), image_data.end(), volume_data.begin(),
-	               [min, max](T v) -> uint8_t { return static_cast<uint8_t>(std::numeric_limits<uint8_t>::max() * std::max(0.0f, std::min(1.0f, (static_cast<float>(v) - min) / (max - min)))); });
+	// Reads a whole block, the length of the last block of the file is rounded up to the alignment and the read stops at the end of the file
+	void read_block(uint8_t *buffer, size_t offset, size_t n_bytes) const
+	{
+		size_t aligned_bytes = (n_bytes + alignment - 1) / alignment * alignment;
+		size_t done          = 0;
+		while (done < n_bytes)
+		{
+			ssize_t result = pread(fd, buffer + done, aligned_bytes - done, static_cast<off_t>(offset + done));
+			if (result < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (result <= 0)
+			{
+				throw std::runtime_error("File error");
+			}
+			if (done + static_cast<size_t>(result) >= n_bytes)
+			{
+				break;
+			}
 
-	return volume_data;
+			// O_DIRECT offsets must stay aligned, so a short read is resumed from the last aligned byte it reached
+			size_t aligned_done = (done + static_cast<size_t>(result)) / alignment * alignment;
+			if (aligned_done == done)
+			{
+				throw std::runtime_error("File error");
+			}
+			done = aligned_done;
+		}
+	}
+
+	int    fd;
+	size_t file_size = 0;
+	size_t alignment = 4096;
+};
+
+const size_t DirectFile::block_size;
+
+// Converts straight from the blocks of a DirectFile
+template <typename T>
+class DirectReader : public LoadVolume::Reader
+{
+  public:
+	// Returns nullptr if the file system does not support O_DIRECT
+	static std::unique_ptr<LoadVolume::Reader> open(std::string filename_data, const LoadVolume::Header &header, bool native_16bit)
+	{
+		auto file = DirectFile::open(filename_data, expected_file_size(header, sizeof(T)));
+		if (!file)
+		{
+			return nullptr;
+		}
+		return std::unique_ptr<LoadVolume::Reader>(new DirectReader<T>(std::move(file), header, native_16bit));
+	}
+
+	virtual void read(size_t first_voxel, size_t n_voxels, uint8_t *dst) override
+	{
+		// Blocks are voxel aligned since the block size is a multiple of the voxel size
+		size_t byte_begin  = first_voxel * sizeof(T);
+		size_t byte_end    = (first_voxel + n_voxels) * sizeof(T);
+		size_t output_size = convert.get_output_size();
+		file->for_each_block(byte_begin, byte_end, [&](const uint8_t *block, size_t block_begin, size_t block_bytes) {
+			size_t lo = std::max(byte_begin, block_begin);
+			size_t hi = std::min(byte_end, block_begin + block_bytes);
+			convert.convert_range(reinterpret_cast<const T *>(block + (lo - block_begin)), (hi - lo) / sizeof(T), dst + (lo - byte_begin) / sizeof(T) * output_size);
+		});
+	}
+
+  private:
+	DirectReader(std::unique_ptr<DirectFile> file, const LoadVolume::Header &header, bool native_16bit) :
+	    file(std::move(file)),
+	    convert(header.normalisation_range.x, header.normalisation_range.y, header.endianness == "big", LoadVolume::get_format<T>(native_16bit) == VK_FORMAT_R8_UNORM)
+	{
+		format = LoadVolume::get_format<T>(native_16bit);
+	}
+
+	std::unique_ptr<DirectFile> file;
+	VolumeConverter<T>          convert;
+};
+#endif
+}        // namespace
+
+template <typename T>
+glm::vec2 LoadVolume::find_range(std::string filename_data, const Header &header)
+{
+	boost::interprocess::file_mapping  mapping;
+	boost::interprocess::mapped_region region = map_file(filename_data, mapping);
+	if (region.get_size() != expected_file_size(header, sizeof(T)))
+	{
+		throw std::runtime_error("File size does not match expected size for the given image format/dimensions");
+	}
+	region.advise(boost::interprocess::mapped_region::advice_sequential);
+
+	VoxelRange range = ::find_range(static_cast<const T *>(region.get_address()), region.get_size() / sizeof(T), header.endianness == "big",
+	                                header.percentiles.x, header.percentiles.y);
+	if (range.max <= range.min)
+	{
+		// Constant volume, any range containing the value normalises it to zero
+		range.max = range.min + 1.0f;
+	}
+	return glm::vec2(range.min, range.max);
+}
+
+template <typename T>
+std::unique_ptr<LoadVolume::Reader> LoadVolume::open_impl(std::string filename_data, const Header &header, ReaderType type, bool native_16bit)
+{
+	if (header.format == "bricked")
+	{
+		return BrickedVolume::open<T>(filename_data, header, native_16bit);
+	}
+	else if (header.format == "compressed")
+	{
+		return CompressedVolume::open<T>(filename_data, header, native_16bit);
+	}
+	else if (header.format != "raw")
+	{
+		throw std::runtime_error("unsupported volume format: " + header.format);
+	}
+
+	switch (type)
+	{
+		case ReaderType::Direct:
+#if defined(LOAD_VOLUME_DIRECT_IO)
+			if (auto reader = DirectReader<T>::open(filename_data, header, native_16bit))
+			{
+				return reader;
+			}
+#endif
+			// Fall back to memory mapping where O_DIRECT is unavailable
+			return std::make_unique<MemoryMappedReader<T>>(filename_data, header, native_16bit);
+		case ReaderType::MemoryMapped:
+			return std::make_unique<MemoryMappedReader<T>>(filename_data, header, native_16bit);
+		case ReaderType::Stream:
+		default:
+			return std::make_unique<StreamReader<T>>(filename_data, header, native_16bit);
+	}
 }
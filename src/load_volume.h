@@ -17,7 +17,9 @@
 
 #pragma once
 
+#include <memory>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include <glm/glm.hpp>
@@ -31,17 +33,90 @@ class LoadVolume
 		VkExtent3D  extent;
 		glm::vec3   voxel_size;
 		glm::vec2   normalisation_range;
+		bool        auto_range = false;        // "auto [lower upper]" normalisation range, found from the data between the given percentiles
+		glm::vec2   percentiles{0.0f, 100.0f};
 		std::string type;
 		std::string endianness;
+		std::string format;        // "raw", "bricked" or "compressed", optional sixth header line
+		std::string codec;         // compression codec of the compressed format
 		glm::mat4   image_transform;
 		glm::vec2   tf_range;
 		float       alpha_factor;
 	};
 
-	static Header               load_header(std::string filename_header);
-	static std::vector<uint8_t> load_data(std::string filename_data, const Header &header);
+	enum class ReaderType : int
+	{
+		Stream       = 0,
+		MemoryMapped = 1,
+		Direct       = 2        // O_DIRECT reads on Linux, bypassing the page cache, otherwise MemoryMapped
+	};
+
+	/**
+	 * @brief Reads a range of voxels from a volume data file and converts them to the reader's format
+	 *
+	 * Voxels are indexed in file order (x fastest, then y, then z).
+	 * Implementations convert straight into the destination, which is typically a mapped staging buffer, so that no host copy of the whole volume is kept.
+	 */
+	class Reader
+	{
+	  public:
+		virtual ~Reader() = default;
+
+		// Writes n_voxels voxels of get_format() to dst
+		virtual void read(size_t first_voxel, size_t n_voxels, uint8_t *dst) = 0;
+
+		// Hint that a range will be read next so the reader can start fetching it while the current range is converted
+		virtual void prefetch(size_t first_voxel, size_t n_voxels)
+		{}
+
+		// Format of the voxels written by read()
+		VkFormat get_format() const
+		{
+			return format;
+		}
+
+	  protected:
+		VkFormat format = VK_FORMAT_R8_UNORM;
+	};
+
+	/**
+	 * @brief Format of the GPU volume for voxel type T
+	 *
+	 * Voxels are normalised to R8_UNORM, unless native_16bit is set and T is 16-bit, in which case they are kept as R16_UNORM/R16_SNORM and windowed on the GPU.
+	 */
+	template <typename T>
+	static VkFormat get_format(bool native_16bit)
+	{
+		if (!native_16bit || sizeof(T) != 2)
+		{
+			return VK_FORMAT_R8_UNORM;
+		}
+		return std::is_signed<T>::value ? VK_FORMAT_R16_SNORM : VK_FORMAT_R16_UNORM;
+	}
+
+	// Bytes per voxel of a format returned by get_format()
+	static size_t get_format_size(VkFormat format);
+
+	static Header                  load_header(std::string filename_header);
+	static std::vector<uint8_t>    load_data(std::string filename_data, const Header &header);
+	static std::unique_ptr<Reader> open(std::string filename_data, const Header &header, ReaderType type = ReaderType::MemoryMapped, bool native_16bit = false);
+
+	/**
+	 * @brief Replaces an automatic normalisation range with the range found from the voxels of a raw data file, does nothing otherwise
+	 *
+	 * The data file is scanned in parallel through a memory mapping, so a file which fits in the page cache is read from disk once and then converted from the cache.
+	 * Throws with ReaderType::Direct, as the scan would read the file again before the single uncached pass of the reader.
+	 * open() resolves automatic ranges itself, call this first when the range is needed.
+	 */
+	static void resolve_auto_range(std::string filename_data, Header &header, ReaderType type = ReaderType::MemoryMapped);
+
+	// Reads the first five (required) lines of a header file verbatim
+	static std::vector<std::string> load_header_lines(std::string filename_header);
 
   private:
 	template <typename T>
-	static std::vector<uint8_t> load_data_impl(std::string filename_data, const Header &header);
+	static glm::vec2 find_range(std::string filename_data, const Header &header);
+
+	template <typename T>
+	static std::unique_ptr<Reader> open_impl(std::string filename_data, const Header &header, ReaderType type, bool native_16bit);
 };
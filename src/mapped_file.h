@@ -0,0 +1,64 @@
+/* Copyright (c) 2019, Lachlan Deakin
+*
+* SPDX-License-Identifier: Apache-2.0
+*
+* Licensed under the Apache License, Version 2.0 the "License";
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#if defined(__unix__) || defined(__APPLE__)
+#	include <sys/mman.h>
+#	include <unistd.h>
+#endif
+
+/**
+ * @brief Hints that the byte range [begin, end) of a mapped region will be read soon, so the kernel can page it in in the background
+ *
+ * No-op on platforms without posix_madvise.
+ */
+inline void prefetch_mapped_range(const boost::interprocess::mapped_region &region, size_t begin, size_t end)
+{
+#if defined(__unix__) || defined(__APPLE__)
+	static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	begin                         = std::min(begin, region.get_size()) / page_size * page_size;
+	end                           = std::min(end, region.get_size());
+	if (end > begin)
+	{
+		posix_madvise(static_cast<char *>(region.get_address()) + begin, end - begin, POSIX_MADV_WILLNEED);
+	}
+#endif
+}
+
+// Maps a whole file read only, mapping must outlive the returned region
+inline boost::interprocess::mapped_region map_file(std::string filename, boost::interprocess::file_mapping &mapping)
+{
+	using namespace boost::interprocess;
+	try
+	{
+		mapping = file_mapping(filename.c_str(), read_only);
+		return mapped_region(mapping, read_only);
+	}
+	catch (const interprocess_exception &e)
+	{
+		throw std::runtime_error(std::string("Failed to map data file: ") + e.what());
+	}
+}
@@ -0,0 +1,55 @@
+/* Copyright (c) 2019, Lachlan Deakin
+*
+* SPDX-License-Identifier: Apache-2.0
+*
+* Licensed under the Apache License, Version 2.0 the "License";
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#pragma once
+
+#include <algorithm>
+
+#include "thread_pool.h"
+
+/**
+ * @brief Splits [begin, end) into contiguous ranges of at least grain elements and calls f(range_begin, range_end) on each range from the workers of ThreadPool::get()
+ *
+ * The calling thread also processes ranges. The first exception thrown by any range is rethrown once all ranges have finished.
+ */
+template <typename F>
+void parallel_for(size_t begin, size_t end, size_t grain, F &&f)
+{
+	if (end <= begin)
+	{
+		return;
+	}
+
+	auto & pool     = ThreadPool::get();
+	size_t n        = end - begin;
+	size_t n_ranges = std::max<size_t>(1, std::min(pool.get_concurrency(), n / std::max<size_t>(1, grain)));
+	if (n_ranges == 1)
+	{
+		f(begin, end);
+		return;
+	}
+
+	size_t range = (n + n_ranges - 1) / n_ranges;
+	pool.run(n_ranges, [&f, begin, end, range](size_t i) {
+		size_t range_begin = begin + i * range;
+		size_t range_end   = std::min(end, range_begin + range);
+		if (range_begin < range_end)
+		{
+			f(range_begin, range_end);
+		}
+	});
+}
@@ -0,0 +1,141 @@
+/* Copyright (c) 2019, Lachlan Deakin
+*
+* SPDX-License-Identifier: Apache-2.0
+*
+* Licensed under the Apache License, Version 2.0 the "License";
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool &ThreadPool::get()
+{
+	static ThreadPool pool(std::max<size_t>(1, std::thread::hardware_concurrency()) - 1);
+	return pool;
+}
+
+ThreadPool::ThreadPool(size_t n_workers)
+{
+	workers.reserve(n_workers);
+	for (size_t i = 0; i < n_workers; ++i)
+	{
+		workers.emplace_back(&ThreadPool::worker, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	job_added.notify_all();
+	for (auto &worker : workers)
+	{
+		worker.join();
+	}
+}
+
+size_t ThreadPool::get_concurrency() const
+{
+	return workers.size() + 1;
+}
+
+void ThreadPool::run(size_t n_tasks, const std::function<void(size_t)> &task)
+{
+	if (n_tasks == 0)
+	{
+		return;
+	}
+
+	auto job     = std::make_shared<Job>();
+	job->task    = &task;
+	job->n_tasks = n_tasks;
+	if (n_tasks > 1 && !workers.empty())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push_back(job);
+		}
+		if (n_tasks == 2)
+		{
+			job_added.notify_one();
+		}
+		else
+		{
+			job_added.notify_all();
+		}
+	}
+
+	// The caller works on its own job, then waits for the tasks claimed by workers
+	work(*job);
+	{
+		std::unique_lock<std::mutex> lock(job->mutex);
+		job->finished.wait(lock, [&job]() { return job->n_finished.load() == job->n_tasks; });
+	}
+	if (job->exception)
+	{
+		std::rethrow_exception(job->exception);
+	}
+}
+
+void ThreadPool::work(Job &job)
+{
+	for (size_t i = job.next++; i < job.n_tasks; i = job.next++)
+	{
+		try
+		{
+			(*job.task)(i);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(job.mutex);
+			if (!job.exception)
+			{
+				job.exception = std::current_exception();
+			}
+		}
+		if (++job.n_finished == job.n_tasks)
+		{
+			// Lock so the notification cannot fall between the waiter's test and its wait
+			std::lock_guard<std::mutex> lock(job.mutex);
+			job.finished.notify_all();
+		}
+	}
+}
+
+void ThreadPool::worker()
+{
+	for (;;)
+	{
+		std::shared_ptr<Job> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			job_added.wait(lock, [this]() { return stop || !jobs.empty(); });
+			if (stop)
+			{
+				return;
+			}
+
+			// Jobs stay queued until every task is claimed, so idle workers join the oldest job
+			job = jobs.front();
+			if (job->next.load() >= job->n_tasks)
+			{
+				jobs.pop_front();
+				continue;
+			}
+		}
+		work(*job);
+	}
+}
@@ -0,0 +1,79 @@
+/* Copyright (c) 2019, Lachlan Deakin
+*
+* SPDX-License-Identifier: Apache-2.0
+*
+* Licensed under the Apache License, Version 2.0 the "License";
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Persistent worker threads shared by every parallel loop, see parallel_for()
+ *
+ * The pool holds one worker per hardware thread, less the calling thread which always takes part in its own tasks.
+ * run() may be called concurrently and from inside a task: a caller never waits on a task nobody has started, so nested loops cannot deadlock.
+ */
+class ThreadPool
+{
+  public:
+	// The process wide pool, started on first use
+	static ThreadPool &get();
+
+	explicit ThreadPool(size_t n_workers);
+
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool &) = delete;
+
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	// Worker threads plus the calling thread
+	size_t get_concurrency() const;
+
+	// Calls task(i) for each i in [0, n_tasks) and returns once all have finished, the first exception thrown by a task is rethrown
+	void run(size_t n_tasks, const std::function<void(size_t)> &task);
+
+  private:
+	struct Job
+	{
+		const std::function<void(size_t)> *task;
+		size_t                             n_tasks;
+		std::atomic<size_t>                next{0};
+		std::atomic<size_t>                n_finished{0};
+		std::exception_ptr                 exception;
+		std::mutex                         mutex;
+		std::condition_variable            finished;
+	};
+
+	// Runs claimed tasks of job until none are left unclaimed
+	static void work(Job &job);
+
+	void worker();
+
+	std::vector<std::thread>         workers;
+	std::deque<std::shared_ptr<Job>> jobs;
+	std::mutex                       mutex;
+	std::condition_variable          job_added;
+	bool                             stop = false;
+};
@@ -23,6 +23,8 @@ struct TransferFunctionUniform
 	float voxel_alpha_factor;
 	float grad_magnitude_modifier;
   VkBool32 use_gradient;
+  float window_scale;
+  float window_offset;
 #ifndef TRANSFER_FUNCTION_TEXTURE
   float intensity_min;
   float intensity_range_inv;
@@ -0,0 +1,153 @@
+/* Copyright (c) 2019, Lachlan Deakin
+*
+* SPDX-License-Identifier: Apache-2.0
+*
+* Licensed under the Apache License, Version 2.0 the "License";
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "bricked_volume.h"
+#include "compressed_volume.h"
+#include "load_volume.h"
+
+namespace
+{
+void print_usage()
+{
+	std::cout << "Converts a raw volume and its header to the bricked or compressed volume format.\n"
+	          << "Usage:\n"
+	          << "  vconvert <input> <output> [--format=<bricked|compressed>] [--brick=<edge length>] [--threshold=<value>] [--chunk=<voxels>]\n"
+	          << "    --format     output format (default bricked)\n"
+	          << "    --brick      bricked: brick edge length in voxels (default 32)\n"
+	          << "    --threshold  bricked: bricks with all voxels at or below this value are also stored as a single value, which is lossy (default only constant bricks)\n"
+	          << "    --chunk      compressed: voxels per independently compressed chunk (default 1048576)\n";
+}
+}        // namespace
+
+int main(int argc, char *argv[])
+{
+	std::string input, output;
+	std::string format        = "bricked";
+	uint32_t    brick_size    = 32;
+	uint32_t    chunk_voxels  = 1 << 20;
+	bool        has_threshold = false;
+	float       threshold     = -std::numeric_limits<float>::infinity();
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if (arg.compare(0, 9, "--format=") == 0)
+		{
+			format = arg.substr(9);
+		}
+		else if (arg.compare(0, 8, "--chunk=") == 0)
+		{
+			chunk_voxels = static_cast<uint32_t>(std::stoul(arg.substr(8)));
+		}
+		else if (arg.compare(0, 8, "--brick=") == 0)
+		{
+			brick_size = static_cast<uint32_t>(std::stoul(arg.substr(8)));
+		}
+		else if (arg.compare(0, 12, "--threshold=") == 0)
+		{
+			threshold     = std::stof(arg.substr(12));
+			has_threshold = true;
+		}
+		else if (input.empty())
+		{
+			input = arg;
+		}
+		else if (output.empty())
+		{
+			output = arg;
+		}
+		else
+		{
+			print_usage();
+			return 1;
+		}
+	}
+	if (input.empty() || output.empty() || (format != "bricked" && format != "compressed"))
+	{
+		print_usage();
+		return 1;
+	}
+
+	try
+	{
+		auto header = LoadVolume::load_header(input + ".header");
+		if (header.format != "raw")
+		{
+			throw std::runtime_error("input must be a raw volume");
+		}
+
+		// An automatic normalisation range is resolved once here and written to the output header
+		bool auto_range = header.auto_range;
+		LoadVolume::resolve_auto_range(input, header);
+		if (has_threshold && format == "bricked" && (header.type == "uint16_t" || header.type == "int16_t"))
+		{
+			std::cerr << "Warning: --threshold replaces bricks of 16-bit voxels by their minimum, voxels below the threshold are lost when loaded with --native16" << std::endl;
+		}
+
+		const auto  start = std::chrono::system_clock::now();
+		std::string format_line, summary;
+		if (format == "bricked")
+		{
+			auto stats  = BrickedVolume::convert(input, header, output, brick_size, threshold);
+			format_line = "bricked # data file format";
+			summary     = "Stored " + std::to_string(stats.n_stored_bricks) + " of " + std::to_string(stats.n_bricks) + " bricks, " + std::to_string(stats.file_size) + " bytes";
+		}
+		else
+		{
+			auto stats  = CompressedVolume::convert(input, header, output, chunk_voxels);
+			format_line = "compressed " + CompressedVolume::codec_to_string(CompressedVolume::Codec::DeltaBitpack) + " # data file format and codec";
+			summary     = "Compressed " + std::to_string(stats.n_chunks) + " chunks, " + std::to_string(stats.file_size) + " bytes";
+		}
+
+		// Same header with the format appended
+		auto lines = LoadVolume::load_header_lines(input + ".header");
+		if (auto_range)
+		{
+			std::ostringstream range;
+			range << std::setprecision(std::numeric_limits<float>::max_digits10) << header.normalisation_range.x << " " << header.normalisation_range.y << " # normalisation range";
+			lines[2] = range.str();
+		}
+		std::ofstream file(output + ".header");
+		for (auto &line : lines)
+		{
+			file << line << "\n";
+		}
+		file << format_line << "\n";
+		if (!file)
+		{
+			throw std::runtime_error("Failed to write header file");
+		}
+
+		const std::chrono::duration<float> dur = std::chrono::system_clock::now() - start;
+		std::cout << summary << " in " << dur.count() << "s" << std::endl;
+	}
+	catch (const std::exception &e)
+	{
+		std::cerr << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
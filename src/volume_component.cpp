@@ -17,12 +17,43 @@
 
 #include "volume_component.h"
 
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#include "common/logging.h"
+#include "core/command_pool.h"
+#include "fence_pool.h"
+
 #include "load_volume.h"
 
 using namespace vkb;
 
+constexpr uint32_t Volume::histogram_bins;
+constexpr uint32_t Volume::distance_map_levels;
+constexpr uint32_t Volume::proxy_bricks_max;
+
+namespace
+{
+// Distance maps are fetched per block, without filtering
+std::unique_ptr<core::Sampler> create_distance_map_sampler(Device &device)
+{
+	VkSamplerCreateInfo sampler_info{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+	sampler_info.maxAnisotropy = 1.0f;
+	sampler_info.magFilter     = VK_FILTER_NEAREST;
+	sampler_info.minFilter     = VK_FILTER_NEAREST;
+	sampler_info.mipmapMode    = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	sampler_info.addressModeU  = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.addressModeV  = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.addressModeW  = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	return std::make_unique<core::Sampler>(device, sampler_info);
+}
+}        // namespace
+
 Volume::Volume(const std::string &name) :
     Component{name},
+    occupied_block_min(0),
+    occupied_block_max(std::numeric_limits<int32_t>::max()),
     image_transform(glm::mat4(1.0f))
 {}
 
@@ -53,16 +84,39 @@ void Volume::upload_texture_with_staging(CommandBuffer &    command_buffer,
 }
 
 bool Volume::load_from_file(vkb::RenderContext &render_context, std::string filename, uint32_t distance_map_block_size /* = 4 */)
+{
+	auto &     device = render_context.get_device();
+	auto &     queue  = device.get_queue_by_flags(VK_QUEUE_GRAPHICS_BIT, 0);
+	std::mutex queue_mutex;
+	return load_from_file(device, {queue, queue_mutex, queue.get_family_index()}, filename, distance_map_block_size);
+}
+
+bool Volume::load_from_file(vkb::Device &device, UploadQueue upload_queue, std::string filename, uint32_t distance_map_block_size /* = 4 */)
 {
 	using namespace vkb;
 
-	auto                 header      = LoadVolume::load_header(filename + ".header");
-	std::vector<uint8_t> volume_data = LoadVolume::load_data(filename, header);
-	size_t               data_size   = volume_data.size() * sizeof(uint8_t);
-	auto &               extent      = header.extent;
-	set_image_transform(header.image_transform);
+	this->filename = filename;
 
-	auto &device = render_context.get_device();
+	auto header = LoadVolume::load_header(filename + ".header");
+	LoadVolume::resolve_auto_range(filename, header, options.reader_type);
+	auto reader = LoadVolume::open(filename, header, options.reader_type, options.native_16bit);
+	if (reader->get_format() != VK_FORMAT_R8_UNORM)
+	{
+		// Compute shaders load the volume as a storage image and the fragment shader filters it
+		VkFormatProperties format_properties;
+		vkGetPhysicalDeviceFormatProperties(device.get_gpu().get_handle(), reader->get_format(), &format_properties);
+		VkFormatFeatureFlags required = VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+		if ((format_properties.optimalTilingFeatures & required) != required || !device.get_gpu().get_features().shaderStorageImageExtendedFormats)
+		{
+			LOGW("16-bit volume images are not supported by this device, {} is quantised to 8 bits", filename);
+			reader = LoadVolume::open(filename, header, options.reader_type);
+		}
+	}
+	options.window = header.normalisation_range;
+
+	auto & extent     = header.extent;
+	size_t voxel_size = LoadVolume::get_format_size(reader->get_format());
+	set_image_transform(header.image_transform);
 
 	// Create transfer function
 	VkExtent3D tf_extent         = {256, 256, 1};
@@ -71,9 +125,10 @@ bool Volume::load_from_file(vkb::RenderContext &render_context, std::string file
                                                             VMA_MEMORY_USAGE_GPU_ONLY);
 	transfer_function.image_view = std::make_unique<core::ImageView>(*transfer_function.image, VK_IMAGE_VIEW_TYPE_2D);
 	transfer_function_staging    = std::make_unique<core::Buffer>(device, 256 * 256 * sizeof(glm::u8vec4), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, 0);
+	transfer_function_occupancy  = std::make_unique<core::Buffer>(device, 257 * 257 * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, 0);
 
 	// Create volume image and upload
-	volume.image      = std::make_unique<core::Image>(device, extent, VK_FORMAT_R8_UNORM,
+	volume.image      = std::make_unique<core::Image>(device, extent, reader->get_format(),
                                                  VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
                                                  VMA_MEMORY_USAGE_GPU_ONLY);
 	volume.image_view = std::make_unique<core::ImageView>(*volume.image, VK_IMAGE_VIEW_TYPE_3D);
@@ -81,58 +136,139 @@ bool Volume::load_from_file(vkb::RenderContext &render_context, std::string file
 	if (options.use_precomputed_gradient)
 	{
 		gradient.image      = std::make_unique<core::Image>(device, extent, VK_FORMAT_R8_UNORM,
-                                                       VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                                                       VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
                                                        VMA_MEMORY_USAGE_GPU_ONLY);
 		gradient.image_view = std::make_unique<core::ImageView>(*gradient.image, VK_IMAGE_VIEW_TYPE_3D);
 	}
 
 	// Create swap image (populated later with compute shader)
-	// Distance maps are created with a call to set_number_of_distance_maps()
-	auto       rndUp             = [](uint32_t x, uint32_t y) { return (x + y - 1) / y; };
-	VkExtent3D extent_occupancy  = {rndUp(extent.width, distance_map_block_size), rndUp(extent.height, distance_map_block_size), rndUp(extent.depth, distance_map_block_size)};
-	distance_map_swap.image      = std::make_unique<core::Image>(device, extent_occupancy, VK_FORMAT_R8_UINT,
-                                                            VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
-                                                            VMA_MEMORY_USAGE_GPU_ONLY);
-	distance_map_swap.image_view = std::make_unique<core::ImageView>(*distance_map_swap.image, VK_IMAGE_VIEW_TYPE_3D);
-
-	// Upload volume image
+	// Distance maps and further swap images are created with calls to set_number_of_distance_maps() and set_number_of_distance_map_swaps()
+	auto       rndUp                    = [](uint32_t x, uint32_t y) { return (x + y - 1) / y; };
+	VkExtent3D extent_occupancy         = {rndUp(extent.width, distance_map_block_size), rndUp(extent.height, distance_map_block_size), rndUp(extent.depth, distance_map_block_size)};
+	distance_map_swaps.resize(1);
+	distance_map_swaps[0].image         = std::make_unique<core::Image>(device, extent_occupancy, VK_FORMAT_R8_UINT,
+                                                                   VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                                                                   VMA_MEMORY_USAGE_GPU_ONLY);
+	distance_map_swaps[0].image_view    = std::make_unique<core::ImageView>(*distance_map_swaps[0].image, VK_IMAGE_VIEW_TYPE_3D);
+	block_statistics.image              = std::make_unique<core::Image>(device, extent_occupancy, VK_FORMAT_R8G8B8A8_UNORM,
+                                                                   VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                                                                   VMA_MEMORY_USAGE_GPU_ONLY);
+	block_statistics.image_view         = std::make_unique<core::ImageView>(*block_statistics.image, VK_IMAGE_VIEW_TYPE_3D);
+	block_statistics_apron.image        = std::make_unique<core::Image>(device, extent_occupancy, VK_FORMAT_R8G8B8A8_UNORM,
+                                                                   VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                                                                   VMA_MEMORY_USAGE_GPU_ONLY);
+	block_statistics_apron.image_view   = std::make_unique<core::ImageView>(*block_statistics_apron.image, VK_IMAGE_VIEW_TYPE_3D);
+
+	// Upload volume image in Z-slabs through a small ring of staging buffers
+	// Reading and converting the next slab overlaps the copies of the slabs already submitted, so staging memory stays bounded by options.staging_budget
 	{
-		auto &    command_buffer = device.request_command_buffer();
-		FencePool fence_pool{device};
-		command_buffer.begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+		const size_t ring_size    = 3;
+		size_t       slice_voxels = static_cast<size_t>(extent.width) * static_cast<size_t>(extent.height);
+		size_t       slab_depth   = std::max(size_t(1), std::min<size_t>(extent.depth, options.staging_budget / ring_size / (slice_voxels * voxel_size)));
+
+		// Slab offsets must be a multiple of the queue's image transfer granularity, a granularity of zero only allows whole image copies
+		auto &   queue       = upload_queue.queue;
+		uint32_t granularity = device.get_gpu().get_queue_family_properties()[queue.get_family_index()].minImageTransferGranularity.depth;
+		slab_depth           = granularity == 0 ? extent.depth : std::min<size_t>(extent.depth, (slab_depth + granularity - 1) / granularity * granularity);
 
-		// Upload data into the vulkan image memory
-		core::Buffer stage_buffer{command_buffer.get_device(), data_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, 0};
-		stage_buffer.update({volume_data.data(), volume_data.data() + data_size});
-		upload_texture_with_staging(command_buffer, stage_buffer, *volume.image, *volume.image_view);
+		struct StagingSlot
+		{
+			std::unique_ptr<core::Buffer> buffer;
+			std::unique_ptr<FencePool>    fence_pool;
+			std::unique_ptr<CommandPool>  command_pool;
+		};
+		std::vector<StagingSlot> ring(std::min(ring_size, (extent.depth + slab_depth - 1) / slab_depth));
+		for (auto &slot : ring)
+		{
+			slot.buffer       = std::make_unique<core::Buffer>(device, slab_depth * slice_voxels * voxel_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, 0);
+			slot.fence_pool   = std::make_unique<FencePool>(device);
+			slot.command_pool = std::make_unique<CommandPool>(device, queue.get_family_index());
+		}
 
+		size_t slab_index = 0;
+		for (uint32_t z = 0; z < extent.depth; z += static_cast<uint32_t>(slab_depth), ++slab_index)
 		{
-			// Prepare volume and gradient for fragment shader
-			ImageMemoryBarrier memory_barrier{};
-			memory_barrier.old_layout      = VK_IMAGE_LAYOUT_UNDEFINED;
-			memory_barrier.new_layout      = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			memory_barrier.src_access_mask = 0;
-			memory_barrier.dst_access_mask = VK_ACCESS_SHADER_READ_BIT;
-			memory_barrier.src_stage_mask  = VK_PIPELINE_STAGE_TRANSFER_BIT;
-			memory_barrier.dst_stage_mask  = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-
-			command_buffer.image_memory_barrier(*volume.image_view, memory_barrier);
-			if (options.use_precomputed_gradient)
+			uint32_t depth = static_cast<uint32_t>(std::min<size_t>(slab_depth, extent.depth - z));
+			auto &   slot  = ring[slab_index % ring.size()];
+
+			// Wait for the copy which last used this staging buffer
+			slot.fence_pool->wait();
+			slot.fence_pool->reset();
+			slot.command_pool->reset_pool();
+
+			// Convert directly into the mapped staging buffer, then hint the reader to fetch the next slab
+			reader->read(z * slice_voxels, depth * slice_voxels, slot.buffer->map());
+			slot.buffer->flush();
+			slot.buffer->unmap();
+			if (z + depth < extent.depth)
 			{
-				command_buffer.image_memory_barrier(*gradient.image_view, memory_barrier);
+				reader->prefetch((z + depth) * slice_voxels, std::min<size_t>(slab_depth, extent.depth - z - depth) * slice_voxels);
 			}
-			command_buffer.image_memory_barrier(*transfer_function.image_view, memory_barrier);
-		}
 
-		// End recording
-		command_buffer.end();
-		auto &queue = device.get_queue_by_flags(VK_QUEUE_GRAPHICS_BIT, 0);
-		queue.submit(command_buffer, device.request_fence());
+			auto &command_buffer = slot.command_pool->request_command_buffer();
+			command_buffer.begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+			if (z == 0)
+			{
+				// Prepare for transfer
+				ImageMemoryBarrier memory_barrier{};
+				memory_barrier.old_layout      = VK_IMAGE_LAYOUT_UNDEFINED;
+				memory_barrier.new_layout      = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				memory_barrier.src_access_mask = 0;
+				memory_barrier.dst_access_mask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				memory_barrier.src_stage_mask  = VK_PIPELINE_STAGE_HOST_BIT;
+				memory_barrier.dst_stage_mask  = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+				command_buffer.image_memory_barrier(*volume.image_view, memory_barrier);
+			}
+
+			// Copy slab
+			VkBufferImageCopy buffer_copy_region{};
+			buffer_copy_region.imageSubresource.layerCount = volume.image_view->get_subresource_range().layerCount;
+			buffer_copy_region.imageSubresource.aspectMask = volume.image_view->get_subresource_range().aspectMask;
+			buffer_copy_region.imageOffset                 = {0, 0, static_cast<int32_t>(z)};
+			buffer_copy_region.imageExtent                 = {extent.width, extent.height, depth};
+
+			command_buffer.copy_buffer_to_image(*slot.buffer, *volume.image, {buffer_copy_region});
 
-		// Wait for the command buffer to finish its work before destroying the staging buffer
-		device.get_fence_pool().wait();
-		device.get_fence_pool().reset();
-		device.get_command_pool().reset_pool();
+			if (z + depth == extent.depth)
+			{
+				if (queue.get_family_index() == upload_queue.owner_family_index)
+				{
+					// Prepare volume for fragment shader
+					ImageMemoryBarrier memory_barrier{};
+					memory_barrier.old_layout      = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+					memory_barrier.new_layout      = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+					memory_barrier.src_access_mask = VK_ACCESS_TRANSFER_WRITE_BIT;
+					memory_barrier.dst_access_mask = VK_ACCESS_SHADER_READ_BIT;
+					memory_barrier.src_stage_mask  = VK_PIPELINE_STAGE_TRANSFER_BIT;
+					memory_barrier.dst_stage_mask  = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+					command_buffer.image_memory_barrier(*volume.image_view, memory_barrier);
+					prepare_for_shader_read(command_buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+				}
+				else
+				{
+					// Release the volume to the queue family it is used on, the matching acquire is recorded by acquire_ownership()
+					release_family_index = queue.get_family_index();
+					acquire_family_index = upload_queue.owner_family_index;
+					record_ownership_transfer(command_buffer, VK_ACCESS_TRANSFER_WRITE_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+				}
+			}
+
+			// End recording
+			command_buffer.end();
+			{
+				std::lock_guard<std::mutex> lock(upload_queue.mutex);
+				queue.submit(command_buffer, slot.fence_pool->request_fence());
+			}
+		}
+
+		// Wait for the remaining copies to finish before destroying the staging buffers
+		for (auto &slot : ring)
+		{
+			slot.fence_pool->wait();
+		}
 	}
 
 	// Create samplers
@@ -152,6 +288,63 @@ bool Volume::load_from_file(vkb::RenderContext &render_context, std::string file
 	return true;
 }
 
+void Volume::acquire_ownership(vkb::CommandBuffer &command_buffer)
+{
+	if (acquire_family_index == VK_QUEUE_FAMILY_IGNORED)
+	{
+		return;
+	}
+
+	// The acquiring queue may be compute only, the fragment shader stage is only valid on a graphics queue
+	auto                 queue_flags    = command_buffer.get_device().get_gpu().get_queue_family_properties()[acquire_family_index].queueFlags;
+	VkPipelineStageFlags dst_stage_mask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	if (queue_flags & VK_QUEUE_GRAPHICS_BIT)
+	{
+		dst_stage_mask |= VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	}
+
+	record_ownership_transfer(command_buffer, 0, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dst_stage_mask);
+	prepare_for_shader_read(command_buffer, dst_stage_mask);
+
+	release_family_index = VK_QUEUE_FAMILY_IGNORED;
+	acquire_family_index = VK_QUEUE_FAMILY_IGNORED;
+}
+
+void Volume::record_ownership_transfer(vkb::CommandBuffer &command_buffer, VkAccessFlags src_access_mask, VkAccessFlags dst_access_mask,
+                                       VkPipelineStageFlags src_stage_mask, VkPipelineStageFlags dst_stage_mask)
+{
+	// vkb::ImageMemoryBarrier has no queue family indices, so the release and acquire barriers are recorded directly
+	VkImageMemoryBarrier barrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+	barrier.oldLayout           = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout           = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcAccessMask       = src_access_mask;
+	barrier.dstAccessMask       = dst_access_mask;
+	barrier.srcQueueFamilyIndex = release_family_index;
+	barrier.dstQueueFamilyIndex = acquire_family_index;
+	barrier.image               = volume.image->get_handle();
+	barrier.subresourceRange    = volume.image_view->get_subresource_range();
+
+	vkCmdPipelineBarrier(command_buffer.get_handle(), src_stage_mask, dst_stage_mask, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void Volume::prepare_for_shader_read(vkb::CommandBuffer &command_buffer, VkPipelineStageFlags dst_stage_mask)
+{
+	// Prepare gradient and transfer function for fragment shader, both are populated later with compute shaders
+	ImageMemoryBarrier memory_barrier{};
+	memory_barrier.old_layout      = VK_IMAGE_LAYOUT_UNDEFINED;
+	memory_barrier.new_layout      = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	memory_barrier.src_access_mask = 0;
+	memory_barrier.dst_access_mask = VK_ACCESS_SHADER_READ_BIT;
+	memory_barrier.src_stage_mask  = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	memory_barrier.dst_stage_mask  = dst_stage_mask;
+
+	if (options.use_precomputed_gradient)
+	{
+		command_buffer.image_memory_barrier(*gradient.image_view, memory_barrier);
+	}
+	command_buffer.image_memory_barrier(*transfer_function.image_view, memory_barrier);
+}
+
 void Volume::set_number_of_distance_maps(vkb::RenderContext &render_context, size_t n)
 {
 	if (n <= distance_maps.size())
@@ -163,23 +356,130 @@ void Volume::set_number_of_distance_maps(vkb::RenderContext &render_context, siz
 
 	auto &device = render_context.get_device();
 
-	// Create samplers
-	VkSamplerCreateInfo sampler_info{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
-	sampler_info.maxAnisotropy = 1.0f;
-	sampler_info.magFilter     = VK_FILTER_NEAREST;
-	sampler_info.minFilter     = VK_FILTER_NEAREST;
-	sampler_info.mipmapMode    = VK_SAMPLER_MIPMAP_MODE_NEAREST;
-	sampler_info.addressModeU  = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-	sampler_info.addressModeV  = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-	sampler_info.addressModeW  = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-
 	for (auto &distance_map : distance_maps)
 	{
-		distance_map.image      = std::make_unique<core::Image>(device, distance_map_swap.image->get_extent(), distance_map_swap.image->get_format(),
-                                                           VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+		distance_map.image      = std::make_unique<core::Image>(device, distance_map_swaps[0].image->get_extent(), distance_map_swaps[0].image->get_format(),
+                                                           VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
                                                            VMA_MEMORY_USAGE_GPU_ONLY);
 		distance_map.image_view = std::make_unique<core::ImageView>(*distance_map.image, VK_IMAGE_VIEW_TYPE_3D);
-		distance_map.sampler    = std::make_unique<core::Sampler>(device, sampler_info);
+		distance_map.sampler    = create_distance_map_sampler(device);
+	}
+}
+
+void Volume::set_packed_distance_maps(vkb::RenderContext &render_context, size_t n, uint32_t bits)
+{
+	if (n <= packed_distance_maps.size() && bits == packed_distance_map_bits)
+	{
+		return;
+	}
+
+	packed_distance_maps.clear();
+	packed_distance_maps.resize(n);
+	packed_distance_map_bits = bits;
+
+	auto &     device = render_context.get_device();
+	VkExtent3D extent = distance_map_swaps[0].image->get_extent();
+	uint32_t   blocks = 8 / bits;
+	extent.width      = (extent.width + blocks - 1) / blocks;
+
+	for (auto &packed_distance_map : packed_distance_maps)
+	{
+		packed_distance_map.image      = std::make_unique<core::Image>(device, extent, VK_FORMAT_R8_UINT,
+                                                                  VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+                                                                  VMA_MEMORY_USAGE_GPU_ONLY);
+		packed_distance_map.image_view = std::make_unique<core::ImageView>(*packed_distance_map.image, VK_IMAGE_VIEW_TYPE_3D);
+		packed_distance_map.sampler    = create_distance_map_sampler(device);
+	}
+}
+
+void Volume::release_distance_maps()
+{
+	distance_maps.clear();
+}
+
+void Volume::set_number_of_distance_map_swaps(vkb::RenderContext &render_context, size_t n)
+{
+	if (n <= distance_map_swaps.size())
+	{
+		return;
+	}
+
+	auto & device     = render_context.get_device();
+	size_t n_existing = distance_map_swaps.size();
+	distance_map_swaps.resize(n);
+	for (size_t i = n_existing; i < n; ++i)
+	{
+		auto &swap      = distance_map_swaps[i];
+		swap.image      = std::make_unique<core::Image>(device, distance_map_swaps[0].image->get_extent(), distance_map_swaps[0].image->get_format(),
+                                                   VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                                                   VMA_MEMORY_USAGE_GPU_ONLY);
+		swap.image_view = std::make_unique<core::ImageView>(*swap.image, VK_IMAGE_VIEW_TYPE_3D);
+	}
+}
+
+void Volume::create_distance_map_levels(vkb::RenderContext &render_context)
+{
+	if (!coarse_distance_maps.empty())
+	{
+		return;
+	}
+
+	auto &     device = render_context.get_device();
+	VkExtent3D extent = distance_maps.at(0).image->get_extent();
+	coarse_distance_maps.resize(distance_map_levels - 1);
+	for (auto &coarse_distance_map : coarse_distance_maps)
+	{
+		extent                         = {(extent.width + 1) / 2, (extent.height + 1) / 2, (extent.depth + 1) / 2};
+		coarse_distance_map.image      = std::make_unique<core::Image>(device, extent, VK_FORMAT_R8_UINT,
+                                                                  VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                                                                  VMA_MEMORY_USAGE_GPU_ONLY);
+		coarse_distance_map.image_view = std::make_unique<core::ImageView>(*coarse_distance_map.image, VK_IMAGE_VIEW_TYPE_3D);
+		coarse_distance_map.sampler    = create_distance_map_sampler(device);
+	}
+}
+
+void Volume::create_proxy_geometry(vkb::RenderContext &render_context)
+{
+	if (proxy_bricks.image)
+	{
+		return;
+	}
+
+	auto &     device         = render_context.get_device();
+	VkExtent3D map_extent     = distance_map_swaps.at(0).image->get_extent();
+	uint32_t   map_extent_max = std::max(std::max(map_extent.width, map_extent.height), map_extent.depth);
+	proxy_brick_blocks        = (map_extent_max + proxy_bricks_max - 1) / proxy_bricks_max;
+	VkExtent3D extent         = {(map_extent.width + proxy_brick_blocks - 1) / proxy_brick_blocks,
+                            (map_extent.height + proxy_brick_blocks - 1) / proxy_brick_blocks,
+                            (map_extent.depth + proxy_brick_blocks - 1) / proxy_brick_blocks};
+	proxy_bricks.image        = std::make_unique<core::Image>(device, extent, VK_FORMAT_R8_UINT,
+                                                         VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+                                                         VMA_MEMORY_USAGE_GPU_ONLY);
+	proxy_bricks.image_view   = std::make_unique<core::ImageView>(*proxy_bricks.image, VK_IMAGE_VIEW_TYPE_3D);
+	proxy_bricks.sampler      = create_distance_map_sampler(device);
+
+	// Each brick has at most 6 boundary faces
+	size_t n_bricks = static_cast<size_t>(extent.width) * static_cast<size_t>(extent.height) * static_cast<size_t>(extent.depth);
+	proxy_faces     = std::make_unique<core::Buffer>(device, n_bricks * 6 * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+	proxy_draw      = std::make_unique<core::Buffer>(device, sizeof(VkDrawIndexedIndirectCommand),
+                                                VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                VMA_MEMORY_USAGE_GPU_ONLY);
+}
+
+void Volume::add_shader_defines(vkb::ShaderVariant &variant) const
+{
+	switch (volume.image->get_format())
+	{
+		case VK_FORMAT_R16_UNORM:
+			variant.add_define("VOLUME_FORMAT r16");
+			variant.add_define("VOLUME_PRECISION highp");
+			break;
+		case VK_FORMAT_R16_SNORM:
+			variant.add_define("VOLUME_FORMAT r16_snorm");
+			variant.add_define("VOLUME_PRECISION highp");
+			break;
+		default:
+			break;
 	}
 }
 
@@ -203,6 +503,17 @@ const Volume::Image &Volume::get_gradient() const
 	return gradient;
 }
 
+void Volume::set_gradient_updated()
+{
+	gradient_updated = true;
+	gradient_window  = options.window;
+}
+
+bool Volume::is_gradient_outdated() const
+{
+	return !gradient_updated || gradient_window != options.window;
+}
+
 const Volume::Image &Volume::get_transfer_function() const
 {
 	return transfer_function;
@@ -213,9 +524,85 @@ const Volume::Image &Volume::get_distance_map(size_t idx /* = 0 */) const
 	return distance_maps.at(idx);
 }
 
-const Volume::Image &Volume::get_distance_map_swap() const
+const Volume::Image &Volume::get_packed_distance_map(size_t idx /* = 0 */) const
+{
+	return packed_distance_maps.at(idx);
+}
+
+const Volume::Image &Volume::get_distance_map_swap(size_t idx /* = 0 */) const
+{
+	return distance_map_swaps.at(idx);
+}
+
+const Volume::Image &Volume::get_distance_map_level(size_t level) const
+{
+	return level == 0 ? distance_maps.at(0) : coarse_distance_maps.at(level - 1);
+}
+
+const Volume::Image &Volume::get_proxy_bricks() const
+{
+	return proxy_bricks;
+}
+
+const vkb::core::Buffer &Volume::get_proxy_faces() const
+{
+	return *proxy_faces;
+}
+
+const vkb::core::Buffer &Volume::get_proxy_draw() const
+{
+	return *proxy_draw;
+}
+
+uint32_t Volume::get_proxy_brick_blocks() const
+{
+	return proxy_brick_blocks;
+}
+
+void Volume::set_occupied_block_bounds(const glm::ivec3 &min, const glm::ivec3 &max)
+{
+	occupied_block_min = min;
+	occupied_block_max = max;
+}
+
+const glm::ivec3 &Volume::get_occupied_block_min() const
+{
+	return occupied_block_min;
+}
+
+const glm::ivec3 &Volume::get_occupied_block_max() const
+{
+	return occupied_block_max;
+}
+
+const Volume::Image &Volume::get_block_statistics() const
+{
+	return block_statistics;
+}
+
+const Volume::Image &Volume::get_block_statistics_apron() const
+{
+	return block_statistics_apron;
+}
+
+const vkb::core::Buffer &Volume::get_transfer_function_occupancy() const
+{
+	return *transfer_function_occupancy;
+}
+
+const std::string &Volume::get_filename() const
+{
+	return filename;
+}
+
+const std::vector<uint32_t> &Volume::get_histogram() const
+{
+	return histogram;
+}
+
+void Volume::set_histogram(std::vector<uint32_t> histogram)
 {
-	return distance_map_swap;
+	this->histogram = std::move(histogram);
 }
 
 glm::mat4 &Volume::get_image_transform()
@@ -230,6 +617,23 @@ TransferFunctionUniform Volume::get_transfer_function_uniform()
 	transfer_function_uniform.voxel_alpha_factor      = options.voxel_alpha_factor;
 	transfer_function_uniform.grad_magnitude_modifier = 1.0f;
 	transfer_function_uniform.use_gradient            = options.gradient_max != options.gradient_min;
+
+	// Native 16-bit volumes are sampled as v / 65535 (UNORM) or v / 32767 (SNORM), map the window to [0, 1]
+	float normalised_max = 0.0f;
+	switch (volume.image->get_format())
+	{
+		case VK_FORMAT_R16_UNORM:
+			normalised_max = 65535.0f;
+			break;
+		case VK_FORMAT_R16_SNORM:
+			normalised_max = 32767.0f;
+			break;
+		default:
+			break;
+	}
+	float window_range_inv                  = 1.0f / (options.window.y - options.window.x);
+	transfer_function_uniform.window_scale  = normalised_max > 0.0f ? normalised_max * window_range_inv : 1.0f;
+	transfer_function_uniform.window_offset = normalised_max > 0.0f ? -options.window.x * window_range_inv : 0.0f;
 #ifndef TRANSFER_FUNCTION_TEXTURE
 	transfer_function_uniform.intensity_min       = options.intensity_min;
 	transfer_function_uniform.intensity_range_inv = 1.0f / (options.intensity_max - options.intensity_min);
@@ -239,27 +643,66 @@ TransferFunctionUniform Volume::get_transfer_function_uniform()
 	return transfer_function_uniform;
 }
 
+float Volume::get_alpha(float intensity, float gradient) const
+{
+	auto clamp = [](float x, float min, float max) {
+		return std::min(std::max(x, min), max);
+	};
+	// Matches get_color() in transfer_function.glsl, which multiplies by the inverse ranges
+	bool  use_gradient = options.gradient_max != options.gradient_min;
+	float alpha_i      = clamp((intensity - options.intensity_min) * (1.0f / (options.intensity_max - options.intensity_min)), 0.0f, 1.0f);
+	float alpha_g      = use_gradient ? clamp((gradient - options.gradient_min) * (1.0f / (options.gradient_max - options.gradient_min)), 0.0f, 1.0f) : 1.0f;
+	return alpha_i * alpha_g;
+}
+
+uint64_t Volume::get_occupied_voxel_count() const
+{
+	if (histogram.empty())
+	{
+		throw std::runtime_error("The histogram of " + get_name() + " has not been computed");
+	}
+
+	// Sum the bins the transfer function maps to a non-zero alpha, bins are centred on i / (histogram_bins - 1)
+	uint64_t count = 0;
+	for (uint32_t g = 0; g < histogram_bins; ++g)
+		for (uint32_t i = 0; i < histogram_bins; ++i)
+		{
+			if (get_alpha(i / static_cast<float>(histogram_bins - 1), g / static_cast<float>(histogram_bins - 1)) > 0.0f)
+			{
+				count += histogram[g * histogram_bins + i];
+			}
+		}
+	return count;
+}
+
+bool Volume::is_occupied_voxel_count_exact() const
+{
+	return volume.image->get_format() == VK_FORMAT_R8_UNORM && options.use_precomputed_gradient;
+}
+
 void Volume::update_transfer_function_texture(vkb::CommandBuffer &command_buffer)
 {
 	// Update the transfer function texture
 
 	std::vector<glm::u8vec4> tex(256 * 256);        // FIXME: Allocate once
-	auto                     clamp = [](float x, float min, float max) {
-        return std::min(std::max(x, min), max);
-	};
-	float  i_inv        = 1.0f / (options.intensity_max - options.intensity_min);
-	float  g_inv        = 1.0f / (options.gradient_max - options.gradient_min);
-	bool   use_gradient = options.gradient_max != options.gradient_min;
-	size_t idx          = 0;
+	size_t                   idx = 0;
 	for (float g = 0; g < 256; ++g)
 		for (float i = 0; i < 256; ++i, idx++)
 		{
-			float   alpha_i = clamp(((i / 255.0f) - options.intensity_min) * i_inv, 0.0f, 1.0f);
-			float   alpha_g = use_gradient ? clamp(((g / 255.0f) - options.gradient_min) * g_inv, 0.0f, 1.0f) : 1.0f;
-			uint8_t alpha   = static_cast<uint8_t>(clamp(alpha_i * alpha_g * 255, 0, 255));
-			tex.at(idx)     = glm::u8vec4(alpha);
+			uint8_t alpha = static_cast<uint8_t>(std::min(std::max(get_alpha(i / 255.0f, g / 255.0f) * 255, 0.0f), 255.0f));
+			tex.at(idx)   = glm::u8vec4(alpha);
 		}
 	transfer_function_staging->update(reinterpret_cast<const uint8_t *>(tex.data()), tex.size() * sizeof(glm::u8vec4));
+
+	// Summed area table of texels with non-zero alpha, lets occupancy maps test a block's intensity x gradient range in constant time
+	std::vector<uint32_t> occupied_texels(257 * 257, 0);
+	for (size_t g = 0; g < 256; ++g)
+		for (size_t i = 0; i < 256; ++i)
+		{
+			occupied_texels[(g + 1) * 257 + i + 1] = (tex[g * 256 + i].a > 0 ? 1 : 0) + occupied_texels[g * 257 + i + 1] +
+			                                         occupied_texels[(g + 1) * 257 + i] - occupied_texels[g * 257 + i];
+		}
+	transfer_function_occupancy->update(reinterpret_cast<const uint8_t *>(occupied_texels.data()), occupied_texels.size() * sizeof(uint32_t));
 	upload_texture_with_staging(command_buffer, *transfer_function_staging,
 	                            *get_transfer_function().image, *get_transfer_function().image_view);
 
@@ -17,15 +17,20 @@
 
 #pragma once
 
+#include <mutex>
+
 #include <glm/glm.hpp>
 
 #include "core/image.h"
 #include "core/image_view.h"
+#include "core/queue.h"
 #include "core/sampler.h"
+#include "core/shader_module.h"
 #include "rendering/render_context.h"
 #include "scene_graph/component.h"
 #include "scene_graph/node.h"
 
+#include "load_volume.h"
 #include "transfer_function.h"
 
 class Volume : public vkb::sg::Component
@@ -34,12 +39,48 @@ class Volume : public vkb::sg::Component
 	Volume(const std::string &name);
 	virtual ~Volume() = default;
 
+	/**
+	 * @brief Queue used to upload a volume, submissions are guarded by mutex so that loader threads can share the queue
+	 *
+	 * If the queue family differs from owner_family_index, ownership of the volume image is released to owner_family_index
+	 * and acquire_ownership() must be recorded on that queue family before the volume is used.
+	 */
+	struct UploadQueue
+	{
+		const vkb::Queue &queue;
+		std::mutex &      mutex;
+		uint32_t          owner_family_index;
+	};
+
 	bool load_from_file(vkb::RenderContext &render_context, std::string filename, uint32_t distance_map_block_size = 4);
 
+	// Thread safe, does not touch the render context so it can run on a loader thread
+	bool load_from_file(vkb::Device &device, UploadQueue upload_queue, std::string filename, uint32_t distance_map_block_size = 4);
+
+	void acquire_ownership(vkb::CommandBuffer &command_buffer);
+
 	void set_image_transform(const glm::mat4 &mat);
 
 	void set_number_of_distance_maps(vkb::RenderContext &render_context, size_t n);
 
+	// Distance maps packed to bits per block for the ray caster (4 = capped distance, 1 = empty bit), see distance_map_pack.comp
+	void set_packed_distance_maps(vkb::RenderContext &render_context, size_t n, uint32_t bits);
+
+	// Frees the distance maps, e.g. once they are packed, set_number_of_distance_maps() creates them again
+	void release_distance_maps();
+
+	// Swap images for distance map passes which process several directions at once, there is always at least one
+	void set_number_of_distance_map_swaps(vkb::RenderContext &render_context, size_t n);
+
+	// Coarser levels of the first distance map, each with twice the block size of the level below, see get_distance_map_level()
+	void create_distance_map_levels(vkb::RenderContext &render_context);
+
+	// Brick occupancy and face buffers of the occupied brick proxy geometry, see ComputeProxyGeometry
+	void create_proxy_geometry(vkb::RenderContext &render_context);
+
+	// Adds the defines matching the format of the volume image, shaders default to R8_UNORM
+	void add_shader_defines(vkb::ShaderVariant &variant) const;
+
 	virtual std::type_index get_type() override;
 
 	struct Options
@@ -48,6 +89,18 @@ class Volume : public vkb::sg::Component
 		float voxel_alpha_factor       = 1.0f;
 		bool  use_precomputed_gradient = true;
 
+		// How the volume data file is read, memory mapping converts straight into the staging buffer
+		LoadVolume::ReaderType reader_type = LoadVolume::ReaderType::MemoryMapped;
+
+		// Peak host memory used for staging buffers while uploading the volume, the upload is split into Z-slabs to fit
+		size_t staging_budget = 64 << 20;
+
+		// Keep 16-bit volumes as R16_UNORM/R16_SNORM rather than quantising them to 8 bits at load time
+		bool native_16bit = false;
+
+		// Intensity window of a native 16-bit volume in data values, initialised to the header normalisation range
+		glm::vec2 window = glm::vec2(0.0f, 1.0f);
+
 		// Parameters defining simple grayscale 2D transfer function
 		float intensity_min = 0.0f;
 		float intensity_max = 1.0f;
@@ -66,7 +119,65 @@ class Volume : public vkb::sg::Component
 	const Image &get_gradient() const;
 	const Image &get_transfer_function() const;
 	const Image &get_distance_map(size_t idx = 0) const;
-	const Image &get_distance_map_swap() const;
+	const Image &get_packed_distance_map(size_t idx = 0) const;
+	const Image &get_distance_map_swap(size_t idx = 0) const;
+
+	// Records that the gradient map was computed from the volume under the current window
+	void set_gradient_updated();
+
+	// True until the gradient map is computed, and again once the window changes
+	bool is_gradient_outdated() const;
+
+	// Level 0 is the first distance map
+	const Image &get_distance_map_level(size_t level) const;
+
+	static constexpr uint32_t distance_map_levels = 4;
+
+	// Occupancy of the bricks of the proxy geometry, a brick is a cube of get_proxy_brick_blocks() blocks of the first distance map
+	const Image &get_proxy_bricks() const;
+
+	// Boundary faces of the occupied bricks, one uint32_t per face, see proxy_geometry.comp
+	const vkb::core::Buffer &get_proxy_faces() const;
+
+	// VkDrawIndexedIndirectCommand drawing one instance per face of the proxy geometry
+	const vkb::core::Buffer &get_proxy_draw() const;
+
+	uint32_t get_proxy_brick_blocks() const;
+
+	// Bounding box of the occupied blocks of the distance maps, in blocks with an inclusive maximum, populated by ComputeDistanceMap::update_occupied_block_bounds()
+	// The maximum is less than the minimum if every block is empty, until populated the box spans every block
+	void              set_occupied_block_bounds(const glm::ivec3 &min, const glm::ivec3 &max);
+	const glm::ivec3 &get_occupied_block_min() const;
+	const glm::ivec3 &get_occupied_block_max() const;
+
+	// Bricks per axis of the proxy geometry are capped, which bounds the face buffer
+	static constexpr uint32_t proxy_bricks_max = 64;
+
+	// Per-block (intensity min, intensity max, gradient min, gradient max) over the blocks of the distance maps, populated by ComputeBlockStatistics
+	const Image &get_block_statistics() const;
+
+	// As above, over each block and a one voxel apron around it, see ComputeDistanceMap::set_apron()
+	const Image &get_block_statistics_apron() const;
+
+	// Summed area table of the transfer function texels with non-zero alpha, (256 + 1)^2 uint32_t, updated with the transfer function texture
+	const vkb::core::Buffer &get_transfer_function_occupancy() const;
+
+	// Bins per axis of the joint histogram
+	static constexpr uint32_t histogram_bins = 256;
+
+	// Joint intensity x gradient histogram, counts[gradient_bin * histogram_bins + intensity_bin], empty until computed by ComputeHistogram
+	const std::vector<uint32_t> &get_histogram() const;
+	void                         set_histogram(std::vector<uint32_t> histogram);
+
+	// Number of voxels with a non-zero alpha under the current transfer function, summed from the histogram in O(histogram_bins^2)
+	// Exact for 8-bit volumes with a precomputed gradient, otherwise intensities and gradients are quantised to the bins
+	uint64_t get_occupied_voxel_count() const;
+
+	// Whether get_occupied_voxel_count() is exact, see above
+	bool is_occupied_voxel_count_exact() const;
+
+	// Data file the volume was loaded from, empty until load_from_file()
+	const std::string &get_filename() const;
 
 	glm::mat4 &get_image_transform();
 
@@ -82,12 +193,37 @@ class Volume : public vkb::sg::Component
 	                                 const vkb::core::Image &image, const vkb::core::ImageView &image_view);
 
   private:
+	void record_ownership_transfer(vkb::CommandBuffer &command_buffer, VkAccessFlags src_access_mask, VkAccessFlags dst_access_mask,
+	                               VkPipelineStageFlags src_stage_mask, VkPipelineStageFlags dst_stage_mask);
+
+	void prepare_for_shader_read(vkb::CommandBuffer &command_buffer, VkPipelineStageFlags dst_stage_mask);
+
+	// Opacity of the simple 2D grayscale transfer function
+	float get_alpha(float intensity, float gradient) const;
+
 	vkb::sg::Node *node;
 
 	Image                              volume, gradient, transfer_function;
+	bool                               gradient_updated = false;
+	glm::vec2                          gradient_window;
 	std::unique_ptr<vkb::core::Buffer> transfer_function_staging;
 	std::vector<Image>                 distance_maps;
-	Image                              distance_map_swap;
+	std::vector<Image>                 packed_distance_maps;
+	uint32_t                           packed_distance_map_bits = 0;
+	std::vector<Image>                 distance_map_swaps;
+	std::vector<Image>                 coarse_distance_maps;        // levels 1 and up
+	Image                              proxy_bricks;
+	std::unique_ptr<vkb::core::Buffer> proxy_faces, proxy_draw;
+	uint32_t                           proxy_brick_blocks = 1;
+	glm::ivec3                         occupied_block_min, occupied_block_max;
+	Image                              block_statistics, block_statistics_apron;
+	std::unique_ptr<vkb::core::Buffer> transfer_function_occupancy;
+	std::vector<uint32_t>              histogram;
+	std::string                        filename;
 
 	glm::mat4 image_transform;
+
+	// Pending queue family ownership transfer of the volume image after an upload on a dedicated transfer queue
+	uint32_t release_family_index = VK_QUEUE_FAMILY_IGNORED;
+	uint32_t acquire_family_index = VK_QUEUE_FAMILY_IGNORED;
 };
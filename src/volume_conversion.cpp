@@ -0,0 +1,463 @@
+/* Copyright (c) 2019, Lachlan Deakin
+*
+* SPDX-License-Identifier: Apache-2.0
+*
+* Licensed under the Apache License, Version 2.0 the "License";
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "volume_conversion.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <type_traits>
+
+#include <boost/endian/conversion.hpp>
+
+#include "parallel_for.h"
+
+#if defined(__AVX2__)
+#	include <immintrin.h>
+#	define VOLUME_CONVERSION_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	include <emmintrin.h>
+#	define VOLUME_CONVERSION_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#	include <arm_neon.h>
+#	define VOLUME_CONVERSION_NEON
+#endif
+
+#undef min
+#undef max
+
+namespace
+{
+constexpr size_t conversion_grain = size_t(1) << 20;        // voxels per thread at minimum
+
+template <typename T>
+T reverse_bytes(T v)
+{
+	unsigned char bytes[sizeof(T)];
+	std::memcpy(bytes, &v, sizeof(T));
+	std::reverse(bytes, bytes + sizeof(T));
+	std::memcpy(&v, bytes, sizeof(T));
+	return v;
+}
+
+// Also maps NaN to 0, matching the vectorised paths
+inline uint8_t normalise(float v, float min, float range_inv)
+{
+	float x = (v - min) * range_inv;
+	x       = x > 0.0f ? (x < 1.0f ? x : 1.0f) : 0.0f;
+	return static_cast<uint8_t>(std::numeric_limits<uint8_t>::max() * x);
+}
+
+// 8/16-bit: one table lookup per voxel indexed by the raw bits
+template <typename T>
+void convert(const T *src, size_t n_voxels, uint8_t *dst, const std::vector<uint8_t> &lut, float, float, bool, std::true_type)
+{
+	const VoxelBits<T> *bits   = reinterpret_cast<const VoxelBits<T> *>(src);
+	const uint8_t *     lookup = lut.data();
+	for (size_t i = 0; i < n_voxels; ++i)
+	{
+		dst[i] = lookup[bits[i]];
+	}
+}
+
+#if defined(VOLUME_CONVERSION_AVX2)
+inline __m256 to_float(__m256i x, int32_t)
+{
+	return _mm256_cvtepi32_ps(x);
+}
+
+inline __m256 to_float(__m256i x, uint32_t)
+{
+	// No unsigned conversion before AVX-512, convert the high and low halves separately
+	__m256 hi = _mm256_cvtepi32_ps(_mm256_srli_epi32(x, 16));
+	__m256 lo = _mm256_cvtepi32_ps(_mm256_and_si256(x, _mm256_set1_epi32(0xFFFF)));
+	return _mm256_add_ps(_mm256_mul_ps(hi, _mm256_set1_ps(65536.0f)), lo);
+}
+
+inline __m256 to_float(__m256i x, float)
+{
+	return _mm256_castsi256_ps(x);
+}
+
+template <typename T>
+inline __m256i convert8(const T *src, bool swap, __m256 min, __m256 range_inv)
+{
+	__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+	if (swap)
+	{
+		x = _mm256_shuffle_epi8(x, _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+		                                            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12));
+	}
+	__m256 f = _mm256_mul_ps(_mm256_sub_ps(to_float(x, T()), min), range_inv);
+	f        = _mm256_min_ps(_mm256_max_ps(f, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));        // max_ps returns the second operand for NaN
+	return _mm256_cvttps_epi32(_mm256_mul_ps(f, _mm256_set1_ps(255.0f)));
+}
+
+template <typename T>
+size_t convert_simd(const T *src, size_t n_voxels, uint8_t *dst, float min, float range_inv, bool swap)
+{
+	const __m256  v_min       = _mm256_set1_ps(min);
+	const __m256  v_range_inv = _mm256_set1_ps(range_inv);
+	const __m256i permute     = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	size_t        i           = 0;
+	for (; i + 32 <= n_voxels; i += 32)
+	{
+		__m256i p01 = _mm256_packs_epi32(convert8(src + i, swap, v_min, v_range_inv), convert8(src + i + 8, swap, v_min, v_range_inv));
+		__m256i p23 = _mm256_packs_epi32(convert8(src + i + 16, swap, v_min, v_range_inv), convert8(src + i + 24, swap, v_min, v_range_inv));
+		// packs/packus work per 128-bit lane, permute the 32-bit groups back into order
+		__m256i bytes = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(p01, p23), permute);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), bytes);
+	}
+	return i;
+}
+#elif defined(VOLUME_CONVERSION_SSE2)
+inline __m128 to_float(__m128i x, int32_t)
+{
+	return _mm_cvtepi32_ps(x);
+}
+
+inline __m128 to_float(__m128i x, uint32_t)
+{
+	// No unsigned conversion before AVX-512, convert the high and low halves separately
+	__m128 hi = _mm_cvtepi32_ps(_mm_srli_epi32(x, 16));
+	__m128 lo = _mm_cvtepi32_ps(_mm_and_si128(x, _mm_set1_epi32(0xFFFF)));
+	return _mm_add_ps(_mm_mul_ps(hi, _mm_set1_ps(65536.0f)), lo);
+}
+
+inline __m128 to_float(__m128i x, float)
+{
+	return _mm_castsi128_ps(x);
+}
+
+template <typename T>
+inline __m128i convert4(const T *src, bool swap, __m128 min, __m128 range_inv)
+{
+	__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+	if (swap)
+	{
+		// Swap bytes in each 16-bit word, then swap the words (no pshufb in SSE2)
+		x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+		x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+		x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+	}
+	__m128 f = _mm_mul_ps(_mm_sub_ps(to_float(x, T()), min), range_inv);
+	f        = _mm_min_ps(_mm_max_ps(f, _mm_setzero_ps()), _mm_set1_ps(1.0f));        // max_ps returns the second operand for NaN
+	return _mm_cvttps_epi32(_mm_mul_ps(f, _mm_set1_ps(255.0f)));
+}
+
+template <typename T>
+size_t convert_simd(const T *src, size_t n_voxels, uint8_t *dst, float min, float range_inv, bool swap)
+{
+	const __m128 v_min       = _mm_set1_ps(min);
+	const __m128 v_range_inv = _mm_set1_ps(range_inv);
+	size_t       i           = 0;
+	for (; i + 16 <= n_voxels; i += 16)
+	{
+		__m128i p01 = _mm_packs_epi32(convert4(src + i, swap, v_min, v_range_inv), convert4(src + i + 4, swap, v_min, v_range_inv));
+		__m128i p23 = _mm_packs_epi32(convert4(src + i + 8, swap, v_min, v_range_inv), convert4(src + i + 12, swap, v_min, v_range_inv));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(p01, p23));
+	}
+	return i;
+}
+#elif defined(VOLUME_CONVERSION_NEON)
+inline float32x4_t to_float(uint32x4_t x, int32_t)
+{
+	return vcvtq_f32_s32(vreinterpretq_s32_u32(x));
+}
+
+inline float32x4_t to_float(uint32x4_t x, uint32_t)
+{
+	return vcvtq_f32_u32(x);
+}
+
+inline float32x4_t to_float(uint32x4_t x, float)
+{
+	return vreinterpretq_f32_u32(x);
+}
+
+template <typename T>
+inline uint16x4_t convert4(const T *src, bool swap, float32x4_t min, float32x4_t range_inv)
+{
+	uint32x4_t x = vld1q_u32(reinterpret_cast<const uint32_t *>(src));
+	if (swap)
+	{
+		x = vreinterpretq_u32_u8(vrev32q_u8(vreinterpretq_u8_u32(x)));
+	}
+	float32x4_t f = vmulq_f32(vsubq_f32(to_float(x, T()), min), range_inv);
+	f             = vminq_f32(vmaxq_f32(f, vdupq_n_f32(0.0f)), vdupq_n_f32(1.0f));        // NaN propagates and converts to 0
+	return vmovn_u32(vcvtq_u32_f32(vmulq_f32(f, vdupq_n_f32(255.0f))));
+}
+
+template <typename T>
+size_t convert_simd(const T *src, size_t n_voxels, uint8_t *dst, float min, float range_inv, bool swap)
+{
+	const float32x4_t v_min       = vdupq_n_f32(min);
+	const float32x4_t v_range_inv = vdupq_n_f32(range_inv);
+	size_t            i           = 0;
+	for (; i + 16 <= n_voxels; i += 16)
+	{
+		uint8x8_t lo = vmovn_u16(vcombine_u16(convert4(src + i, swap, v_min, v_range_inv), convert4(src + i + 4, swap, v_min, v_range_inv)));
+		uint8x8_t hi = vmovn_u16(vcombine_u16(convert4(src + i + 8, swap, v_min, v_range_inv), convert4(src + i + 12, swap, v_min, v_range_inv)));
+		vst1q_u8(dst + i, vcombine_u8(lo, hi));
+	}
+	return i;
+}
+#else
+template <typename T>
+size_t convert_simd(const T *, size_t, uint8_t *, float, float, bool)
+{
+	return 0;
+}
+#endif
+
+// 32-bit: multiply by the reciprocal of the normalisation range, vectorised with a scalar tail
+template <typename T>
+void convert(const T *src, size_t n_voxels, uint8_t *dst, const std::vector<uint8_t> &, float min, float range_inv, bool swap, std::false_type)
+{
+	static_assert(sizeof(T) == 4, "vectorised conversion expects 32-bit voxels");
+	size_t i = convert_simd(src, n_voxels, dst, min, range_inv, swap);
+	for (; i < n_voxels; ++i)
+	{
+		T v    = swap ? reverse_bytes(src[i]) : src[i];
+		dst[i] = normalise(static_cast<float>(v), min, range_inv);
+	}
+}
+
+// Endian swap only, voxels keep their type
+template <typename T>
+void copy_native(const T *src, size_t n_voxels, uint8_t *dst, bool swap)
+{
+	if (!swap)
+	{
+		std::memcpy(dst, src, n_voxels * sizeof(T));
+		return;
+	}
+	for (size_t i = 0; i < n_voxels; ++i)
+	{
+		T v = reverse_bytes(src[i]);
+		std::memcpy(dst + i * sizeof(T), &v, sizeof(T));
+	}
+}
+
+// Rank of a percentile among n values, rounding outwards so the range is never narrower than requested
+size_t percentile_rank(float percentile, size_t n, bool upper)
+{
+	double rank = std::max(0.0, std::min(100.0, static_cast<double>(percentile))) / 100.0 * static_cast<double>(n - 1);
+	return static_cast<size_t>(upper ? std::ceil(rank) : std::floor(rank));
+}
+
+// Value of the bin holding the value of the given rank, counts are in ascending value order
+template <typename F>
+float value_at_rank(const std::vector<uint64_t> &counts, size_t rank, F &&bin_value)
+{
+	uint64_t cumulative = 0;
+	for (size_t i = 0; i < counts.size(); ++i)
+	{
+		cumulative += counts[i];
+		if (cumulative > rank)
+		{
+			return bin_value(i);
+		}
+	}
+	return bin_value(counts.size() - 1);
+}
+
+// 8/16-bit: histogram of the raw bits, then sort the occupied bins by value
+template <typename T>
+VoxelRange find_range(const T *src, size_t n_voxels, bool swap, float lower_percentile, float upper_percentile, std::true_type)
+{
+	const size_t          n_bins = size_t(std::numeric_limits<VoxelBits<T>>::max()) + 1;
+	std::vector<uint64_t> histogram(n_bins);
+	std::mutex            mutex;
+	parallel_for(0, n_voxels, conversion_grain, [&](size_t begin, size_t end) {
+		std::vector<uint64_t> local(n_bins);
+		const VoxelBits<T> *  bits = reinterpret_cast<const VoxelBits<T> *>(src);
+		for (size_t i = begin; i < end; ++i)
+		{
+			++local[bits[i]];
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		for (size_t b = 0; b < n_bins; ++b)
+		{
+			histogram[b] += local[b];
+		}
+	});
+
+	std::vector<std::pair<float, uint64_t>> bins;
+	for (size_t raw = 0; raw < n_bins; ++raw)
+	{
+		if (histogram[raw] > 0)
+		{
+			VoxelBits<T> bits = static_cast<VoxelBits<T>>(raw);
+			T            v;
+			std::memcpy(&v, &bits, sizeof(T));
+			bins.emplace_back(static_cast<float>(swap ? reverse_bytes(v) : v), histogram[raw]);
+		}
+	}
+	std::sort(bins.begin(), bins.end());
+
+	std::vector<uint64_t> counts(bins.size());
+	std::transform(bins.begin(), bins.end(), counts.begin(), [](const std::pair<float, uint64_t> &bin) { return bin.second; });
+	auto bin_value = [&](size_t i) { return bins[i].first; };
+	return {value_at_rank(counts, percentile_rank(lower_percentile, n_voxels, false), bin_value),
+	        value_at_rank(counts, percentile_rank(upper_percentile, n_voxels, true), bin_value)};
+}
+
+// 32-bit: minimum and maximum, then a fixed size histogram over that range for percentiles
+template <typename T>
+VoxelRange find_range(const T *src, size_t n_voxels, bool swap, float lower_percentile, float upper_percentile, std::false_type)
+{
+	auto value = [&](size_t i) { return static_cast<float>(swap ? reverse_bytes(src[i]) : src[i]); };
+
+	VoxelRange range{std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity()};
+	size_t     n_valid = 0;
+	std::mutex mutex;
+	parallel_for(0, n_voxels, conversion_grain, [&](size_t begin, size_t end) {
+		VoxelRange local{std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity()};
+		size_t     local_valid = 0;
+		for (size_t i = begin; i < end; ++i)
+		{
+			float v = value(i);
+			if (!std::isnan(v))
+			{
+				local.min = std::min(local.min, v);
+				local.max = std::max(local.max, v);
+				++local_valid;
+			}
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		range.min = std::min(range.min, local.min);
+		range.max = std::max(range.max, local.max);
+		n_valid += local_valid;
+	});
+	if (n_valid == 0)
+	{
+		throw std::runtime_error("Volume has no valid voxels to find a range from");
+	}
+	if ((lower_percentile <= 0.0f && upper_percentile >= 100.0f) || range.max <= range.min || std::isinf(range.max - range.min))
+	{
+		return range;
+	}
+
+	const size_t          n_bins    = 65536;
+	const float           bin_scale = static_cast<float>(n_bins) / (range.max - range.min);
+	std::vector<uint64_t> histogram(n_bins);
+	parallel_for(0, n_voxels, conversion_grain, [&](size_t begin, size_t end) {
+		std::vector<uint64_t> local(n_bins);
+		for (size_t i = begin; i < end; ++i)
+		{
+			float v = value(i);
+			if (!std::isnan(v))
+			{
+				++local[std::min(n_bins - 1, static_cast<size_t>((v - range.min) * bin_scale))];
+			}
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		for (size_t b = 0; b < n_bins; ++b)
+		{
+			histogram[b] += local[b];
+		}
+	});
+
+	// Lower percentiles take the lower edge of their bin and upper percentiles the upper edge
+	auto lower_edge = [&](size_t i) { return range.min + static_cast<float>(i) / bin_scale; };
+	auto upper_edge = [&](size_t i) { return std::min(range.max, range.min + static_cast<float>(i + 1) / bin_scale); };
+	return {value_at_rank(histogram, percentile_rank(lower_percentile, n_valid, false), lower_edge),
+	        value_at_rank(histogram, percentile_rank(upper_percentile, n_valid, true), upper_edge)};
+}
+}        // namespace
+
+template <typename T>
+VoxelRange find_range(const T *src, size_t n_voxels, bool big_endian, float lower_percentile /* = 0.0f */, float upper_percentile /* = 100.0f */)
+{
+	if (n_voxels == 0)
+	{
+		throw std::runtime_error("Volume has no valid voxels to find a range from");
+	}
+	bool swap = big_endian != (boost::endian::order::native == boost::endian::order::big);
+	return find_range(src, n_voxels, swap, lower_percentile, upper_percentile, std::integral_constant<bool, sizeof(T) <= 2>());
+}
+
+template <typename T>
+VolumeConverter<T>::VolumeConverter(float min, float max, bool big_endian, bool normalise /* = true */) :
+    min(min),
+    range_inv(1.0f / (max - min)),
+    swap(big_endian != (boost::endian::order::native == boost::endian::order::big)),
+    normalise(normalise)
+{
+	if (normalise && sizeof(T) <= 2)
+	{
+		// Index by the raw file bits, the result matches the scalar divide exactly
+		lut.resize(size_t(std::numeric_limits<VoxelBits<T>>::max()) + 1);
+		for (size_t raw = 0; raw < lut.size(); ++raw)
+		{
+			VoxelBits<T> bits = static_cast<VoxelBits<T>>(raw);
+			T            v;
+			std::memcpy(&v, &bits, sizeof(T));
+			if (swap)
+			{
+				v = reverse_bytes(v);
+			}
+			lut[raw] = static_cast<uint8_t>(std::numeric_limits<uint8_t>::max() * std::max(0.0f, std::min(1.0f, (static_cast<float>(v) - min) / (max - min))));
+		}
+	}
+}
+
+template <typename T>
+size_t VolumeConverter<T>::get_output_size() const
+{
+	return normalise ? sizeof(uint8_t) : sizeof(T);
+}
+
+template <typename T>
+void VolumeConverter<T>::operator()(const T *src, size_t n_voxels, uint8_t *dst) const
+{
+	size_t output_size = get_output_size();
+	parallel_for(0, n_voxels, conversion_grain, [&](size_t begin, size_t end) {
+		convert_range(src + begin, end - begin, dst + begin * output_size);
+	});
+}
+
+template <typename T>
+void VolumeConverter<T>::convert_range(const T *src, size_t n_voxels, uint8_t *dst) const
+{
+	if (!normalise)
+	{
+		copy_native(src, n_voxels, dst, swap);
+		return;
+	}
+	convert(src, n_voxels, dst, lut, min, range_inv, swap, std::integral_constant<bool, sizeof(T) <= 2>());
+}
+
+template class VolumeConverter<uint8_t>;
+template class VolumeConverter<int8_t>;
+template class VolumeConverter<uint16_t>;
+template class VolumeConverter<int16_t>;
+template class VolumeConverter<uint32_t>;
+template class VolumeConverter<int32_t>;
+template class VolumeConverter<float>;
+
+template VoxelRange find_range<uint8_t>(const uint8_t *, size_t, bool, float, float);
+template VoxelRange find_range<int8_t>(const int8_t *, size_t, bool, float, float);
+template VoxelRange find_range<uint16_t>(const uint16_t *, size_t, bool, float, float);
+template VoxelRange find_range<int16_t>(const int16_t *, size_t, bool, float, float);
+template VoxelRange find_range<uint32_t>(const uint32_t *, size_t, bool, float, float);
+template VoxelRange find_range<int32_t>(const int32_t *, size_t, bool, float, float);
+template VoxelRange find_range<float>(const float *, size_t, bool, float, float);
@@ -0,0 +1,75 @@
+/* Copyright (c) 2019, Lachlan Deakin
+*
+* SPDX-License-Identifier: Apache-2.0
+*
+* Licensed under the Apache License, Version 2.0 the "License";
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// Unsigned integer with the same size as the voxel type T, used to handle raw voxel bits
+template <typename T>
+using VoxelBits = typename std::conditional<sizeof(T) == 1, uint8_t, typename std::conditional<sizeof(T) == 2, uint16_t, uint32_t>::type>::type;
+
+/**
+ * @brief Fused endian swap and normalisation of raw voxels to uint8_t
+ *
+ * Each voxel v is mapped to 255 * clamp((v - min) / (max - min), 0, 1).
+ * 8/16-bit types use a lookup table indexed by the raw file bits, so the endian swap is folded into the table.
+ * Wider types multiply by the reciprocal of the normalisation range, vectorised with AVX2, SSE2 or NEON where available.
+ * Without normalisation voxels are only swapped to native byte order and written as T.
+ * Conversion is split across all hardware threads.
+ */
+template <typename T>
+class VolumeConverter
+{
+  public:
+	VolumeConverter(float min, float max, bool big_endian, bool normalise = true);
+
+	// Bytes written per voxel
+	size_t get_output_size() const;
+
+	void operator()(const T *src, size_t n_voxels, uint8_t *dst) const;
+
+	// Converts on the calling thread, for callers which already split their work across threads
+	void convert_range(const T *src, size_t n_voxels, uint8_t *dst) const;
+
+  private:
+	float min, range_inv;
+	bool  swap;
+	bool  normalise;
+
+	std::vector<uint8_t> lut;
+};
+
+// Range of voxel values, used as the normalisation range
+struct VoxelRange
+{
+	float min;
+	float max;
+};
+
+/**
+ * @brief Finds the range of raw voxel values in a single parallel pass
+ *
+ * The range spans the given lower and upper percentiles in [0, 100], 0 and 100 give the exact minimum and maximum. NaN voxels are ignored.
+ * 8/16-bit types count the raw bits in a histogram, so percentiles are exact.
+ * Wider types find the minimum and maximum, then percentiles other than 0/100 are refined with a second pass over a 65536 bin histogram of that range.
+ */
+template <typename T>
+VoxelRange find_range(const T *src, size_t n_voxels, bool big_endian, float lower_percentile = 0.0f, float upper_percentile = 100.0f);
@@ -0,0 +1,135 @@
+/* Copyright (c) 2019, Lachlan Deakin
+*
+* SPDX-License-Identifier: Apache-2.0
+*
+* Licensed under the Apache License, Version 2.0 the "License";
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include "volume_loader.h"
+
+#include <chrono>
+
+#include "common/logging.h"
+#include "core/device.h"
+
+VolumeLoader::VolumeLoader(vkb::Device &device, uint32_t owner_family_index) :
+    device{device},
+    queue{nullptr},
+    owner_family_index{owner_family_index},
+    async{false}
+{
+	// Prefer a queue family which supports transfers but not graphics or compute, these usually map to the DMA engines
+	auto &queue_family_properties = device.get_gpu().get_queue_family_properties();
+	for (uint32_t family_index = 0; family_index < static_cast<uint32_t>(queue_family_properties.size()); ++family_index)
+	{
+		auto &properties = queue_family_properties[family_index];
+		if ((properties.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(properties.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) && properties.queueCount > 0)
+		{
+			queue = &device.get_queue(family_index, 0);
+			async = true;
+			break;
+		}
+	}
+
+	if (!queue)
+	{
+		queue = &device.get_queue_by_flags(VK_QUEUE_GRAPHICS_BIT, 0);
+		LOGI("No dedicated transfer queue, volumes are loaded before rendering starts");
+	}
+}
+
+VolumeLoader::~VolumeLoader()
+{
+	wait();
+}
+
+bool VolumeLoader::is_async() const
+{
+	return async;
+}
+
+void VolumeLoader::load(std::unique_ptr<Volume> volume, std::string filename, uint32_t distance_map_block_size)
+{
+	auto job      = std::make_unique<Job>();
+	job->volume   = std::move(volume);
+	job->filename = filename;
+
+	Job *j      = job.get();
+	job->thread = std::thread([this, j, distance_map_block_size]() {
+		try
+		{
+			const auto start = std::chrono::system_clock::now();
+			j->volume->load_from_file(device, {*queue, queue_mutex, owner_family_index}, j->filename, distance_map_block_size);
+			const std::chrono::duration<float, std::milli> dur = std::chrono::system_clock::now() - start;
+			LOGI("Loaded {} in {}ms", j->filename, dur.count());
+		}
+		catch (...)
+		{
+			j->exception = std::current_exception();
+		}
+		j->done = true;
+	});
+	jobs.push_back(std::move(job));
+}
+
+std::vector<std::unique_ptr<Volume>> VolumeLoader::poll()
+{
+	std::vector<std::unique_ptr<Volume>> loaded;
+	for (auto it = jobs.begin(); it != jobs.end();)
+	{
+		auto &job = *it;
+		if (!job->done)
+		{
+			++it;
+			continue;
+		}
+
+		if (job->thread.joinable())
+		{
+			job->thread.join();
+		}
+		if (job->exception)
+		{
+			try
+			{
+				std::rethrow_exception(job->exception);
+			}
+			catch (const std::exception &e)
+			{
+				LOGE("Failed to load {}: {}", job->filename, e.what());
+			}
+		}
+		else
+		{
+			loaded.push_back(std::move(job->volume));
+		}
+		it = jobs.erase(it);
+	}
+	return loaded;
+}
+
+void VolumeLoader::wait()
+{
+	for (auto &job : jobs)
+	{
+		if (job->thread.joinable())
+		{
+			job->thread.join();
+		}
+	}
+}
+
+size_t VolumeLoader::get_pending_count() const
+{
+	return jobs.size();
+}
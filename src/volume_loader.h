@@ -0,0 +1,83 @@
+/* Copyright (c) 2019, Lachlan Deakin
+*
+* SPDX-License-Identifier: Apache-2.0
+*
+* Licensed under the Apache License, Version 2.0 the "License";
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "volume_component.h"
+
+namespace vkb
+{
+class Device;
+class Queue;
+}        // namespace vkb
+
+/**
+ * @brief Loads volumes on worker threads, one thread per volume
+ *
+ * Uploads are submitted on a transfer-only queue family when the device has one, so loading continues while the render loop uses the graphics queue.
+ * Otherwise the first graphics queue is shared by the workers and wait() must be called before the render loop starts submitting.
+ */
+class VolumeLoader
+{
+  public:
+	/**
+	 * @param device The device to create the volume resources on
+	 * @param owner_family_index The queue family which uses the loaded volumes, see Volume::acquire_ownership()
+	 */
+	VolumeLoader(vkb::Device &device, uint32_t owner_family_index);
+
+	virtual ~VolumeLoader();
+
+	// True if uploads run on a dedicated transfer queue and can overlap rendering
+	bool is_async() const;
+
+	void load(std::unique_ptr<Volume> volume, std::string filename, uint32_t distance_map_block_size);
+
+	// Returns the volumes which finished loading since the last call, failed loads are logged and dropped
+	std::vector<std::unique_ptr<Volume>> poll();
+
+	// Blocks until all loads have finished
+	void wait();
+
+	size_t get_pending_count() const;
+
+  private:
+	struct Job
+	{
+		std::unique_ptr<Volume> volume;
+		std::string             filename;
+		std::thread             thread;
+		std::atomic<bool>       done{false};
+		std::exception_ptr      exception;
+	};
+
+	vkb::Device &     device;
+	const vkb::Queue *queue;
+	uint32_t          owner_family_index;
+	bool              async;
+	std::mutex        queue_mutex;
+
+	std::vector<std::unique_ptr<Job>> jobs;
+};
@@ -45,6 +45,11 @@ VKBP_DISABLE_WARNINGS()
 #include <spdlog/spdlog.h>
 VKBP_ENABLE_WARNINGS()
 
+#include <cstring>
+#include <limits>
+#include <sstream>
+
+#include "distance_map_cpu.h"
 #include "volume_render_subpass.h"
 
 using namespace vkb;
@@ -72,13 +77,50 @@ void VolumeRenderPlugin::init(const vkb::CommandParser &parser)
 	if (parser.contains(&skipmode_flag))
 	{
 		uint32_t skipmode_read = parser.as<uint32_t>(&skipmode_flag);
-		if (skipmode_read <= 3)
+		if (skipmode_read <= 5)
 		{
 			skipmode = static_cast<VolumeRenderSubpass::SkippingType>(skipmode_read);
 		}
 	}
-	blocksize     = parser.contains(&blocksize_flag) ? parser.as<uint32_t>(&blocksize_flag) : 4;
-	gradient_test = parser.contains(&gradient_test_flag);
+	occupancy_method = ComputeDistanceMap::OccupancyMethod::BlockStatistics;
+	if (parser.contains(&occupancy_flag))
+	{
+		uint32_t occupancy_read = parser.as<uint32_t>(&occupancy_flag);
+		if (occupancy_read <= 3)
+		{
+			occupancy_method = static_cast<ComputeDistanceMap::OccupancyMethod>(occupancy_read);
+		}
+	}
+	distance_kernel = ComputeDistanceMap::DistanceKernel::ZigZag;
+	if (parser.contains(&distkernel_flag))
+	{
+		uint32_t distkernel_read = parser.as<uint32_t>(&distkernel_flag);
+		if (distkernel_read <= 1)
+		{
+			distance_kernel = static_cast<ComputeDistanceMap::DistanceKernel>(distkernel_read);
+		}
+	}
+	unbatched             = parser.contains(&unbatched_flag);
+	packed                = parser.contains(&packed_flag);
+	proxy                 = parser.contains(&proxy_flag);
+	apron                 = parser.contains(&apron_flag);
+	blocksize             = parser.contains(&blocksize_flag) ? parser.as<uint32_t>(&blocksize_flag) : 4;
+	gradient_test         = parser.contains(&gradient_test_flag);
+	validate_voxel_count  = parser.contains(&validate_voxel_count_flag);
+	validate_distance_map = parser.contains(&validate_distance_map_flag);
+	reader_type           = LoadVolume::ReaderType::MemoryMapped;
+	if (parser.contains(&reader_flag))
+	{
+		uint32_t reader_read = parser.as<uint32_t>(&reader_flag);
+		if (reader_read <= 2)
+		{
+			reader_type = static_cast<LoadVolume::ReaderType>(reader_read);
+		}
+	}
+	staging_budget = (parser.contains(&staging_flag) ? parser.as<size_t>(&staging_flag) : 64) << 20;
+	native_16bit   = parser.contains(&native16_flag);
+	cache_dir      = parser.contains(&cachedir_flag) ? parser.as<std::string>(&cachedir_flag) : "";
+	cache          = parser.contains(&cache_flag) || !cache_dir.empty();
 	datasets      = {parser.contains(&dataset_flag) ? parser.as<std::string>(&dataset_flag) : "stag_beetle_832x832x494.uint16"};
 	// FIXME: vkb::FlagType::ManyValues didn't seem to be working, switch to single dataset only for now
 }
@@ -86,7 +128,9 @@ void VolumeRenderPlugin::init(const vkb::CommandParser &parser)
 VolumeRender::VolumeRender() :
     camera(nullptr),
     render_sponza_scene(false),
-    spin_volumes(false)
+    spin_volumes(false),
+    validate_occupied_voxel_count(false),
+    validate_distance_map(false)
 {
 	//set_usage(
 	//    R"(Volume renderer.
@@ -162,7 +206,21 @@ bool VolumeRender::prepare(vkb::Platform &platform)
 	// Prepare compute
 	compute_distance_map         = std::make_unique<ComputeDistanceMap>(*render_context);
 	compute_gradient_map         = std::make_unique<ComputeGradientMap>(*render_context);
+	compute_block_statistics     = std::make_unique<ComputeBlockStatistics>(*render_context);
+	compute_histogram            = std::make_unique<ComputeHistogram>(*render_context);
 	compute_occupied_voxel_count = std::make_unique<ComputeOccupiedVoxelCount>(*render_context);
+	compute_distance_map->set_occupancy_method(plugin.occupancy_method);
+	compute_distance_map->set_distance_kernel(plugin.distance_kernel);
+	compute_distance_map->set_anisotropic_batched(!plugin.unbatched);
+	compute_distance_map->set_packed(plugin.packed);
+	compute_distance_map->set_proxy_geometry(plugin.proxy);
+	compute_distance_map->set_apron(plugin.apron);
+	validate_occupied_voxel_count = plugin.validate_voxel_count;
+	validate_distance_map         = plugin.validate_distance_map;
+	if (plugin.cache)
+	{
+		derived_data_cache = std::make_unique<DerivedDataCache>(plugin.cache_dir);
+	}
 
 	// Load scene and camera
 	load_scene("scenes/sponza/Sponza01.gltf");        // default scene
@@ -173,7 +231,10 @@ bool VolumeRender::prepare(vkb::Platform &platform)
 	// Get input volumetric image filenames
 
 	// Set volume rendering options
-	volume_render_options.skipping_type = plugin.skipmode;
+	volume_render_options.skipping_type        = plugin.skipmode;
+	volume_render_options.packed_distance_maps = plugin.packed;
+	volume_render_options.proxy_geometry       = plugin.proxy;
+	volume_render_options.apron_occupancy      = plugin.apron;
 	if (platform.using_plugin<::plugins::BenchmarkMode>())
 	{
 		volume_render_options.clip_distance         = 1.0f;
@@ -182,7 +243,8 @@ bool VolumeRender::prepare(vkb::Platform &platform)
 		// TEST: Set camera to orthographic
 	}
 
-	// Load all of the volumes
+	// Load all of the volumes on worker threads, they are added to the scene in update() once uploaded
+	volume_loader = std::make_unique<VolumeLoader>(*device, device->get_queue_by_flags(VK_QUEUE_COMPUTE_BIT, 0).get_family_index());
 	for (auto volume_fn : plugin.datasets)
 	{
 		auto volume = std::make_unique<Volume>(volume_fn);
@@ -193,52 +255,18 @@ bool VolumeRender::prepare(vkb::Platform &platform)
 		volume->options.gradient_min             = plugin.gmin;
 		volume->options.gradient_max             = plugin.gmax;
 		volume->options.use_precomputed_gradient = !plugin.gradient_test;
+		volume->options.reader_type              = plugin.reader_type;
+		volume->options.staging_budget           = plugin.staging_budget;
+		volume->options.native_16bit             = plugin.native_16bit;
 
-		// Load from disk and prep textures
-		volume->load_from_file(*render_context, vkb::fs::path::get(vkb::fs::path::Assets, volume_fn), plugin.blocksize);
-
-		auto &device = render_context->get_device();
-
-		// Compute gradient
-		if (volume->options.use_precomputed_gradient)
-		{
-			auto                  transfer_function_uniform = volume->get_transfer_function_uniform();
-			vkb::core::Buffer     b_tf_uniform(device, sizeof(transfer_function_uniform), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VmaMemoryUsage::VMA_MEMORY_USAGE_CPU_TO_GPU);
-			vkb::BufferAllocation a_tf_uniform(b_tf_uniform, b_tf_uniform.get_size(), 0);
-			b_tf_uniform.update(&transfer_function_uniform, sizeof(transfer_function_uniform));
-
-			const auto start          = std::chrono::system_clock::now();
-			auto &     command_buffer = compute_start();
-			compute_gradient_map->compute(command_buffer, *volume, a_tf_uniform);
-			compute_submit(command_buffer);
-			const std::chrono::duration<float, std::milli> dur = std::chrono::system_clock::now() - start;
-			LOGI("Updated gradient map in {}ms", dur.count());
-		}
-
-		update_transfer_function(*volume);
+		volume_loader->load(std::move(volume), vkb::fs::path::get(vkb::fs::path::Assets, volume_fn), plugin.blocksize);
+	}
 
-		// Add volume component to scene
-		auto node = std::make_unique<vkb::sg::Node>(123, volume_fn);
-		node->set_component(*volume);
-		float scale_factor = 1.0f;
-		if (platform.using_plugin<::plugins::BenchmarkMode>())
-		{
-			// Set scale to take up entire viewport
-			glm::vec3 translation, scale, skew;
-			glm::vec4 perspective;
-			glm::quat rotation;
-			glm::decompose(volume->get_image_transform(), scale, rotation, translation, skew, perspective);
-			scale = glm::abs(rotation * glm::vec4(scale, 0.0f));
-			// scale *= sqrt(3.0f);        // fits in view with arbitrary rotation
-			node->get_transform().set_scale(glm::vec3(100.0f * scale_factor) / scale);
-		}
-		else
-		{
-			node->get_transform().set_scale(glm::vec3(100.0f * scale_factor));
-		}
-		volume->set_node(*node);
-		scene->add_node(std::move(node));
-		scene->add_component(std::move(volume));
+	// Without a dedicated transfer queue the loaders share the graphics queue, and benchmarks must not render frames without volumes
+	if (!volume_loader->is_async() || platform.using_plugin<::plugins::BenchmarkMode>())
+	{
+		volume_loader->wait();
+		add_loaded_volumes();
 	}
 
 	// Init render pipeline
@@ -255,6 +283,11 @@ bool VolumeRender::prepare(vkb::Platform &platform)
 
 void VolumeRender::update(float delta_time)
 {
+	if (volume_loader->get_pending_count() > 0 && add_loaded_volumes())
+	{
+		init_render_pipeline();
+	}
+
 	if (spin_volumes)
 	{
 		auto volumes = scene->get_components<Volume>();
@@ -270,6 +303,57 @@ void VolumeRender::update(float delta_time)
 	VulkanSample::update(delta_time);
 }
 
+bool VolumeRender::add_loaded_volumes()
+{
+	auto volumes = volume_loader->poll();
+	for (auto &volume : volumes)
+	{
+		add_volume(std::move(volume));
+	}
+	return !volumes.empty();
+}
+
+void VolumeRender::add_volume(std::unique_ptr<Volume> volume)
+{
+	auto &device = render_context->get_device();
+
+	// Acquire the volume from the upload queue
+	{
+		auto &command_buffer = compute_start();
+		volume->acquire_ownership(command_buffer);
+		compute_submit(command_buffer);
+	}
+
+	uint64_t key = get_derived_data_key(*volume);
+	update_gradient_map(*volume, key);
+	update_block_statistics(*volume, key);
+	update_histogram(*volume, key);
+	update_transfer_function(*volume);
+
+	// Add volume component to scene
+	auto node = std::make_unique<vkb::sg::Node>(123, volume->get_name());
+	node->set_component(*volume);
+	float scale_factor = 1.0f;
+	if (platform->using_plugin<::plugins::BenchmarkMode>())
+	{
+		// Set scale to take up entire viewport
+		glm::vec3 translation, scale, skew;
+		glm::vec4 perspective;
+		glm::quat rotation;
+		glm::decompose(volume->get_image_transform(), scale, rotation, translation, skew, perspective);
+		scale = glm::abs(rotation * glm::vec4(scale, 0.0f));
+		// scale *= sqrt(3.0f);        // fits in view with arbitrary rotation
+		node->get_transform().set_scale(glm::vec3(100.0f * scale_factor) / scale);
+	}
+	else
+	{
+		node->get_transform().set_scale(glm::vec3(100.0f * scale_factor));
+	}
+	volume->set_node(*node);
+	scene->add_node(std::move(node));
+	scene->add_component(std::move(volume));
+}
+
 /**
 * @return Load store info to clear all and store only the swapchain
 */
@@ -360,6 +444,12 @@ void VolumeRender::request_gpu_features(vkb::PhysicalDevice &gpu)
 	gpu.get_mutable_requested_features().shaderClipDistance = gpu.get_features().shaderClipDistance;
 	gpu.get_mutable_requested_features().shaderInt64        = gpu.get_features().shaderInt64;
 	gpu.get_mutable_requested_features().shaderFloat64      = gpu.get_features().shaderFloat64;
+
+	// Storage image access to native 16-bit volumes
+	gpu.get_mutable_requested_features().shaderStorageImageExtendedFormats = gpu.get_features().shaderStorageImageExtendedFormats;
+
+	// Indexing arrays of distance maps in the batched anisotropic distance map kernel
+	gpu.get_mutable_requested_features().shaderStorageImageArrayDynamicIndexing = gpu.get_features().shaderStorageImageArrayDynamicIndexing;
 }
 
 void VolumeRender::prepare_render_context()
@@ -389,6 +479,284 @@ std::unique_ptr<vkb::RenderTarget> VolumeRender::create_render_target(vkb::core:
 	return std::make_unique<vkb::RenderTarget>(std::move(images));
 }
 
+uint64_t VolumeRender::get_derived_data_key(Volume &volume)
+{
+	if (!derived_data_cache)
+	{
+		return 0;
+	}
+
+	auto file_key = derived_data_file_keys.find(volume.get_filename());
+	if (file_key == derived_data_file_keys.end())
+	{
+		try
+		{
+			file_key = derived_data_file_keys.emplace(volume.get_filename(), derived_data_cache->get_file_key(volume.get_filename())).first;
+		}
+		catch (const std::exception &e)
+		{
+			LOGW("Failed to hash {}, derived data is not cached: {}", volume.get_filename(), e.what());
+			return 0;
+		}
+	}
+
+	auto  transfer_function_uniform = volume.get_transfer_function_uniform();
+	auto &extent                    = volume.get_volume().image->get_extent();
+	auto &extent_blocks             = volume.get_block_statistics().image->get_extent();
+
+	std::ostringstream parameters;
+	parameters.precision(std::numeric_limits<float>::max_digits10);
+	parameters << volume.get_volume().image->get_format() << ' '
+	           << extent.width << 'x' << extent.height << 'x' << extent.depth << ' '
+	           << extent_blocks.width << 'x' << extent_blocks.height << 'x' << extent_blocks.depth << ' '
+	           << transfer_function_uniform.window_scale << ' ' << transfer_function_uniform.window_offset << ' '
+	           << transfer_function_uniform.use_gradient << ' ' << transfer_function_uniform.grad_magnitude_modifier << ' '
+	           << Volume::histogram_bins;
+	return derived_data_cache->get_key(file_key->second, parameters.str());
+}
+
+bool VolumeRender::load_cached_image(Volume &volume, const std::string &name, const Volume::Image &image, size_t texel_size, uint64_t key)
+{
+	if (!derived_data_cache || key == 0)
+	{
+		return false;
+	}
+
+	try
+	{
+		const auto &extent = image.image->get_extent();
+		size_t      size   = static_cast<size_t>(extent.width) * extent.height * extent.depth * texel_size;
+		auto        entry  = derived_data_cache->load(volume.get_filename(), name, key);
+		if (!entry || entry->size() != size)
+		{
+			return false;
+		}
+
+		vkb::core::Buffer stage_buffer(render_context->get_device(), size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+		stage_buffer.update(entry->data(), size);
+
+		auto &command_buffer = compute_start();
+		volume.upload_texture_with_staging(command_buffer, stage_buffer, *image.image, *image.image_view);
+
+		vkb::ImageMemoryBarrier memory_barrier{};
+		memory_barrier.old_layout      = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		memory_barrier.new_layout      = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		memory_barrier.src_access_mask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memory_barrier.dst_access_mask = VK_ACCESS_SHADER_READ_BIT;
+		memory_barrier.src_stage_mask  = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		memory_barrier.dst_stage_mask  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		command_buffer.image_memory_barrier(*image.image_view, memory_barrier);
+		compute_submit(command_buffer);
+		return true;
+	}
+	catch (const std::exception &e)
+	{
+		LOGW("Failed to load cached {}: {}", name, e.what());
+		return false;
+	}
+}
+
+std::vector<uint8_t> VolumeRender::read_back_image(const Volume::Image &image, size_t texel_size)
+{
+	const auto &      extent = image.image->get_extent();
+	size_t            size   = static_cast<size_t>(extent.width) * extent.height * extent.depth * texel_size;
+	vkb::core::Buffer readback_buffer(render_context->get_device(), size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU);
+
+	auto &command_buffer = compute_start();
+
+	vkb::ImageMemoryBarrier memory_barrier{};
+	memory_barrier.old_layout      = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	memory_barrier.new_layout      = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	memory_barrier.src_access_mask = VK_ACCESS_SHADER_READ_BIT;
+	memory_barrier.dst_access_mask = VK_ACCESS_TRANSFER_READ_BIT;
+	memory_barrier.src_stage_mask  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	memory_barrier.dst_stage_mask  = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	command_buffer.image_memory_barrier(*image.image_view, memory_barrier);
+
+	VkBufferImageCopy buffer_copy_region{};
+	buffer_copy_region.imageSubresource.layerCount = image.image_view->get_subresource_range().layerCount;
+	buffer_copy_region.imageSubresource.aspectMask = image.image_view->get_subresource_range().aspectMask;
+	buffer_copy_region.imageExtent                 = extent;
+	vkCmdCopyImageToBuffer(command_buffer.get_handle(), image.image->get_handle(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback_buffer.get_handle(), 1, &buffer_copy_region);
+
+	std::swap(memory_barrier.old_layout, memory_barrier.new_layout);
+	std::swap(memory_barrier.src_access_mask, memory_barrier.dst_access_mask);
+	std::swap(memory_barrier.src_stage_mask, memory_barrier.dst_stage_mask);
+	command_buffer.image_memory_barrier(*image.image_view, memory_barrier);
+
+	vkb::BufferMemoryBarrier buffer_barrier{};
+	buffer_barrier.src_access_mask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	buffer_barrier.dst_access_mask = VK_ACCESS_HOST_READ_BIT;
+	buffer_barrier.src_stage_mask  = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	buffer_barrier.dst_stage_mask  = VK_PIPELINE_STAGE_HOST_BIT;
+	command_buffer.buffer_memory_barrier(readback_buffer, 0, size, buffer_barrier);
+	compute_submit(command_buffer);
+
+	const uint8_t *      data = readback_buffer.map();
+	std::vector<uint8_t> result(data, data + size);
+	readback_buffer.unmap();
+	return result;
+}
+
+void VolumeRender::store_cached_image(Volume &volume, const std::string &name, const Volume::Image &image, size_t texel_size, uint64_t key)
+{
+	if (!derived_data_cache || key == 0)
+	{
+		return;
+	}
+
+	try
+	{
+		auto data = read_back_image(image, texel_size);
+		derived_data_cache->store(volume.get_filename(), name, key, data.data(), data.size());
+	}
+	catch (const std::exception &e)
+	{
+		LOGW("Failed to cache {}: {}", name, e.what());
+	}
+}
+
+void VolumeRender::update_gradient_map(Volume &volume, uint64_t key)
+{
+	if (!volume.options.use_precomputed_gradient)
+	{
+		return;
+	}
+
+	const auto start = std::chrono::system_clock::now();
+	if (load_cached_image(volume, "gradient", volume.get_gradient(), 1, key))
+	{
+		volume.set_gradient_updated();
+		const std::chrono::duration<float, std::milli> dur = std::chrono::system_clock::now() - start;
+		LOGI("Loaded cached gradient map in {}ms", dur.count());
+		return;
+	}
+
+	auto                  transfer_function_uniform = volume.get_transfer_function_uniform();
+	vkb::core::Buffer     b_tf_uniform(render_context->get_device(), sizeof(transfer_function_uniform), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VmaMemoryUsage::VMA_MEMORY_USAGE_CPU_TO_GPU);
+	vkb::BufferAllocation a_tf_uniform(b_tf_uniform, b_tf_uniform.get_size(), 0);
+	b_tf_uniform.update(&transfer_function_uniform, sizeof(transfer_function_uniform));
+
+	auto &command_buffer = compute_start();
+	compute_gradient_map->compute(command_buffer, volume, a_tf_uniform);
+	compute_submit(command_buffer);
+	volume.set_gradient_updated();
+
+	const std::chrono::duration<float, std::milli> dur = std::chrono::system_clock::now() - start;
+	LOGI("Updated gradient map in {}ms", dur.count());
+
+	store_cached_image(volume, "gradient", volume.get_gradient(), 1, key);
+}
+
+void VolumeRender::update_block_statistics(Volume &volume, uint64_t key)
+{
+	update_block_statistics(volume, false, key);
+	if (compute_distance_map->get_apron())
+	{
+		update_block_statistics(volume, true, key);
+	}
+}
+
+void VolumeRender::update_block_statistics(Volume &volume, bool apron, uint64_t key)
+{
+	const auto        start = std::chrono::system_clock::now();
+	const std::string name  = apron ? "block_statistics_apron" : "block_statistics";
+	const auto &      image = apron ? volume.get_block_statistics_apron() : volume.get_block_statistics();
+	if (load_cached_image(volume, name, image, 4, key))
+	{
+		const std::chrono::duration<float, std::milli> dur = std::chrono::system_clock::now() - start;
+		LOGI("Loaded cached {} in {}ms", name, dur.count());
+		return;
+	}
+
+	auto                  transfer_function_uniform = volume.get_transfer_function_uniform();
+	vkb::core::Buffer     b_tf_uniform(render_context->get_device(), sizeof(transfer_function_uniform), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VmaMemoryUsage::VMA_MEMORY_USAGE_CPU_TO_GPU);
+	vkb::BufferAllocation a_tf_uniform(b_tf_uniform, b_tf_uniform.get_size(), 0);
+	b_tf_uniform.update(&transfer_function_uniform, sizeof(transfer_function_uniform));
+
+	auto &command_buffer = compute_start();
+	compute_block_statistics->compute(command_buffer, volume, a_tf_uniform, apron);
+	compute_submit(command_buffer);
+
+	const std::chrono::duration<float, std::milli> dur = std::chrono::system_clock::now() - start;
+	LOGI("Updated {} in {}ms", name, dur.count());
+
+	store_cached_image(volume, name, image, 4, key);
+}
+
+void VolumeRender::update_histogram(Volume &volume, uint64_t key)
+{
+	const auto   start = std::chrono::system_clock::now();
+	const size_t size  = Volume::histogram_bins * Volume::histogram_bins * sizeof(uint32_t);
+
+	if (derived_data_cache && key != 0)
+	{
+		try
+		{
+			auto entry = derived_data_cache->load(volume.get_filename(), "histogram", key);
+			if (entry && entry->size() == size)
+			{
+				std::vector<uint32_t> histogram(Volume::histogram_bins * Volume::histogram_bins);
+				std::memcpy(histogram.data(), entry->data(), size);
+				volume.set_histogram(std::move(histogram));
+
+				const std::chrono::duration<float, std::milli> dur = std::chrono::system_clock::now() - start;
+				LOGI("Loaded cached histogram in {}ms", dur.count());
+				return;
+			}
+		}
+		catch (const std::exception &e)
+		{
+			LOGW("Failed to load cached histogram: {}", e.what());
+		}
+	}
+
+	auto                  transfer_function_uniform = volume.get_transfer_function_uniform();
+	vkb::core::Buffer     b_tf_uniform(render_context->get_device(), sizeof(transfer_function_uniform), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VmaMemoryUsage::VMA_MEMORY_USAGE_CPU_TO_GPU);
+	vkb::BufferAllocation a_tf_uniform(b_tf_uniform, b_tf_uniform.get_size(), 0);
+	b_tf_uniform.update(&transfer_function_uniform, sizeof(transfer_function_uniform));
+
+	vkb::core::Buffer     buffer_histogram = compute_histogram->initialise_buffer(render_context->get_device());
+	vkb::BufferAllocation a_buffer_histogram(buffer_histogram, buffer_histogram.get_size(), 0);
+
+	auto &command_buffer = compute_start();
+	compute_histogram->compute(command_buffer, volume, a_buffer_histogram, a_tf_uniform);
+	compute_submit(command_buffer);
+	volume.set_histogram(compute_histogram->get_result(a_buffer_histogram));
+
+	const std::chrono::duration<float, std::milli> dur = std::chrono::system_clock::now() - start;
+	LOGI("Updated histogram in {}ms", dur.count());
+
+	if (derived_data_cache && key != 0)
+	{
+		try
+		{
+			derived_data_cache->store(volume.get_filename(), "histogram", key, volume.get_histogram().data(), size);
+		}
+		catch (const std::exception &e)
+		{
+			LOGW("Failed to cache histogram: {}", e.what());
+		}
+	}
+}
+
+uint64_t VolumeRender::count_occupied_voxels(Volume &volume, vkb::BufferAllocation &transfer_function_uniform)
+{
+	auto &command_buffer = compute_start();
+	if (compute_distance_map->get_occupancy_method() == ComputeDistanceMap::OccupancyMethod::Fused && !compute_distance_map->get_apron())
+	{
+		// Count with the sweep which updates the occupancy map
+		compute_distance_map->compute(command_buffer, volume, transfer_function_uniform, volume_render_options.skipping_type, &compute_occupied_voxel_count->get_reduction());
+	}
+	else
+	{
+		compute_occupied_voxel_count->compute(command_buffer, volume, transfer_function_uniform);
+	}
+	compute_submit(command_buffer);
+	compute_distance_map->release_packed_distance_maps(volume);
+	return compute_occupied_voxel_count->get_result();
+}
+
 void VolumeRender::update_transfer_function(Volume &volume)
 {
 	auto                  transfer_function_uniform = volume.get_transfer_function_uniform();
@@ -398,24 +766,37 @@ void VolumeRender::update_transfer_function(Volume &volume)
 
 	if (platform->using_plugin<::plugins::BenchmarkMode>())
 	{
-		// Get buffer for computing number of occupied voxels
-		vkb::core::Buffer     buffer_occupied_voxel_count = compute_occupied_voxel_count->initialise_buffer(render_context->get_device(), volume);
-		vkb::BufferAllocation a_buffer_occupied_voxel_count(buffer_occupied_voxel_count, buffer_occupied_voxel_count.get_size(), 0);
-
-		// Update transfer function and compute number of occupied voxels
+		// Update transfer function and count occupied voxels
+		// The histogram count is only exact for 8-bit volumes with a precomputed gradient, other volumes are counted with a sweep
 		const auto start = std::chrono::system_clock::now();
 		{
 			auto &command_buffer = compute_start();
 			volume.update_transfer_function_texture(command_buffer);
-			compute_occupied_voxel_count->compute(command_buffer, volume, a_buffer_occupied_voxel_count, a_tf_uniform);
 			compute_submit(command_buffer);
 		}
-		uint64_t                                       n_occupied_voxels       = compute_occupied_voxel_count->get_result(a_buffer_occupied_voxel_count);
+		bool                                           histogram_exact         = volume.is_occupied_voxel_count_exact();
+		uint64_t                                       n_occupied_voxels       = histogram_exact ? volume.get_occupied_voxel_count() : count_occupied_voxels(volume, a_tf_uniform);
 		auto                                           extent                  = volume.get_volume().image->get_extent();
 		size_t                                         n_voxels                = static_cast<size_t>(extent.width) * static_cast<size_t>(extent.height) * static_cast<size_t>(extent.depth);
 		float                                          percent_occupied_voxels = 100.0f * static_cast<float>(n_occupied_voxels) / static_cast<float>(n_voxels);
 		const std::chrono::duration<float, std::milli> dur                     = std::chrono::system_clock::now() - start;
-		LOGI("Occupied voxels: {}% in {}ms", percent_occupied_voxels, dur.count());
+		LOGI("Occupied voxels: {}% in {}ms ({})", percent_occupied_voxels, dur.count(), histogram_exact ? "histogram" : "GPU sweep");
+
+		if (validate_occupied_voxel_count && histogram_exact)
+		{
+			// Count occupied voxels with a sweep over the whole volume
+			const auto                                     start_sweep             = std::chrono::system_clock::now();
+			uint64_t                                       n_occupied_voxels_sweep = count_occupied_voxels(volume, a_tf_uniform);
+			const std::chrono::duration<float, std::milli> dur_sweep               = std::chrono::system_clock::now() - start_sweep;
+			if (n_occupied_voxels_sweep != n_occupied_voxels)
+			{
+				LOGW("Occupied voxel count mismatch: {} from the histogram, {} from the GPU sweep in {}ms", n_occupied_voxels, n_occupied_voxels_sweep, dur_sweep.count());
+			}
+			else
+			{
+				LOGI("Occupied voxel count validated by the GPU sweep in {}ms", dur_sweep.count());
+			}
+		}
 
 		// Update occupancy map
 		const auto start2 = std::chrono::system_clock::now();
@@ -428,6 +809,13 @@ void VolumeRender::update_transfer_function(Volume &volume)
 		}
 		const std::chrono::duration<float, std::milli> dur2 = std::chrono::system_clock::now() - start2;
 		LOGI("Updated occupancy/distance map in {}ms", dur2.count() / static_cast<float>(runs));
+		compute_distance_map->update_occupied_block_bounds(volume);
+
+		if (validate_distance_map)
+		{
+			validate_distance_maps(volume, a_tf_uniform);
+		}
+		compute_distance_map->release_packed_distance_maps(volume);
 	}
 	else
 	{
@@ -440,10 +828,114 @@ void VolumeRender::update_transfer_function(Volume &volume)
 			auto &command_buffer = compute_start();
 			compute_distance_map->compute(command_buffer, volume, a_tf_uniform, volume_render_options.skipping_type);
 			compute_submit(command_buffer);
+			compute_distance_map->update_occupied_block_bounds(volume);
+			compute_distance_map->release_packed_distance_maps(volume);
 		}
 	}
 }
 
+void VolumeRender::validate_distance_maps(Volume &volume, vkb::BufferAllocation &transfer_function_uniform)
+{
+	auto skipping_type = volume_render_options.skipping_type;
+	bool anisotropic   = skipping_type == VolumeRenderSubpass::SkippingType::AnisotropicDistance;
+	bool hierarchical  = skipping_type == VolumeRenderSubpass::SkippingType::HierarchicalDistance;
+	if (!anisotropic && !hierarchical && skipping_type != VolumeRenderSubpass::SkippingType::Distance)
+	{
+		return;
+	}
+
+	// Read the distance maps back before the swap image is overwritten by the occupancy map
+	size_t                            n_distance_maps = anisotropic ? 8 : 1;
+	std::vector<std::vector<uint8_t>> distance_maps(n_distance_maps);
+	for (size_t i = 0; i < n_distance_maps; ++i)
+	{
+		distance_maps[i] = read_back_image(volume.get_distance_map(i), 1);
+	}
+	std::vector<std::vector<uint8_t>> coarse_distance_maps;
+	if (hierarchical)
+	{
+		for (uint32_t level = 1; level < Volume::distance_map_levels; ++level)
+		{
+			coarse_distance_maps.push_back(read_back_image(volume.get_distance_map_level(level), 1));
+		}
+	}
+	{
+		auto &command_buffer = compute_start();
+		compute_distance_map->compute_occupancy(command_buffer, volume, transfer_function_uniform);
+		compute_submit(command_buffer);
+	}
+	auto occupancy_map = read_back_image(volume.get_distance_map_swap(), 1);
+
+	// Distance transform on the CPU
+	const auto                        start  = std::chrono::system_clock::now();
+	auto                              extent = volume.get_distance_map_swap().image->get_extent();
+	std::vector<std::vector<uint8_t>> distance_maps_cpu(n_distance_maps, std::vector<uint8_t>(occupancy_map.size()));
+	if (anisotropic)
+	{
+		std::array<uint8_t *, 8> outputs;
+		for (size_t i = 0; i < 8; ++i)
+		{
+			outputs[i] = distance_maps_cpu[i].data();
+		}
+		compute_distance_map_anisotropic_cpu(occupancy_map.data(), extent, outputs);
+	}
+	else
+	{
+		compute_distance_map_cpu(occupancy_map.data(), extent, distance_maps_cpu[0].data());
+	}
+
+	// Coarser levels, each the distance transform of the occupancy of the finer CPU level
+	std::vector<std::vector<uint8_t>> coarse_distance_maps_cpu;
+	if (hierarchical)
+	{
+		VkExtent3D fine_extent = extent;
+		for (uint32_t level = 1; level < Volume::distance_map_levels; ++level)
+		{
+			const auto &         fine          = level == 1 ? distance_maps_cpu[0] : coarse_distance_maps_cpu.back();
+			VkExtent3D           coarse_extent = {(fine_extent.width + 1) / 2, (fine_extent.height + 1) / 2, (fine_extent.depth + 1) / 2};
+			std::vector<uint8_t> coarse_occupancy_map(static_cast<size_t>(coarse_extent.width) * coarse_extent.height * coarse_extent.depth);
+			std::vector<uint8_t> coarse_distance_map(coarse_occupancy_map.size());
+			compute_coarse_occupancy_cpu(fine.data(), fine_extent, coarse_occupancy_map.data());
+			compute_distance_map_cpu(coarse_occupancy_map.data(), coarse_extent, coarse_distance_map.data());
+			coarse_distance_maps_cpu.push_back(std::move(coarse_distance_map));
+			fine_extent = coarse_extent;
+		}
+	}
+	const std::chrono::duration<float, std::milli> dur = std::chrono::system_clock::now() - start;
+
+	bool valid = true;
+	for (size_t i = 0; i < n_distance_maps; ++i)
+	{
+		size_t n_mismatches = 0;
+		for (size_t j = 0; j < occupancy_map.size(); ++j)
+		{
+			n_mismatches += distance_maps[i][j] != distance_maps_cpu[i][j];
+		}
+		if (n_mismatches > 0)
+		{
+			LOGW("Distance map {} mismatch: {} of {} blocks differ from the CPU distance transform", i, n_mismatches, occupancy_map.size());
+			valid = false;
+		}
+	}
+	for (size_t i = 0; i < coarse_distance_maps.size(); ++i)
+	{
+		size_t n_mismatches = 0;
+		for (size_t j = 0; j < coarse_distance_maps[i].size(); ++j)
+		{
+			n_mismatches += coarse_distance_maps[i][j] != coarse_distance_maps_cpu[i][j];
+		}
+		if (n_mismatches > 0)
+		{
+			LOGW("Distance map level {} mismatch: {} of {} blocks differ from the CPU distance transform", i + 1, n_mismatches, coarse_distance_maps[i].size());
+			valid = false;
+		}
+	}
+	if (valid)
+	{
+		LOGI("Distance maps validated by the CPU distance transform in {}ms", dur.count());
+	}
+}
+
 void VolumeRender::draw_gui()
 {
 	auto volumes = scene->get_components<Volume>();
@@ -455,6 +947,11 @@ void VolumeRender::draw_gui()
 			    ImGui::SameLine();
 		    };
 
+		    if (volume_loader->get_pending_count() > 0)
+		    {
+			    ImGui::Text("Loading %d volume(s)...", static_cast<int>(volume_loader->get_pending_count()));
+		    }
+
 		    for (auto volume : volumes)
 		    {
 			    ImGui::PushID(volume->get_name().c_str());
@@ -489,6 +986,25 @@ void VolumeRender::draw_gui()
 			    tf_changed |= ImGui::SliderFloat("Gradient", &volume->options.gradient_max, volume->options.gradient_min, 1.0f);
 			    ImGui::PopItemWidth();
 
+			    // Native 16-bit volumes are windowed on the GPU
+			    if (volume->get_volume().image->get_format() != VK_FORMAT_R8_UNORM)
+			    {
+				    ImGui::Text(" Window:");
+				    gap();
+				    ImGui::PushItemWidth(ImGui::GetWindowSize().x * 0.3f);
+				    glm::vec2 window = volume->options.window;
+				    if (ImGui::DragFloatRange2("Window", &window.x, &window.y, 1.0f, -32768.0f, 65535.0f) && window.y > window.x)
+				    {
+					    volume->options.window = window;
+					    uint64_t key           = get_derived_data_key(*volume);
+					    update_gradient_map(*volume, key);
+					    update_block_statistics(*volume, key);
+					    update_histogram(*volume, key);
+					    tf_changed = true;
+				    }
+				    ImGui::PopItemWidth();
+			    }
+
 			    if (tf_changed)
 			    {
 				    update_transfer_function(*volume);
@@ -500,15 +1016,39 @@ void VolumeRender::draw_gui()
 		    bool changed = false;
 		    ImGui::Text("ESS method:");
 		    ImGui::SameLine();
+		    changed |= ImGui::RadioButton("Distance (Hierarchical)", reinterpret_cast<int *>(&volume_render_options.skipping_type), static_cast<int>(VolumeRenderSubpass::SkippingType::HierarchicalDistance));
+		    ImGui::SameLine();
 		    changed |= ImGui::RadioButton("Distance (Anisotropic)", reinterpret_cast<int *>(&volume_render_options.skipping_type), static_cast<int>(VolumeRenderSubpass::SkippingType::AnisotropicDistance));
 		    ImGui::SameLine();
 		    changed |= ImGui::RadioButton("Distance", reinterpret_cast<int *>(&volume_render_options.skipping_type), static_cast<int>(VolumeRenderSubpass::SkippingType::Distance));
 		    ImGui::SameLine();
 		    changed |= ImGui::RadioButton("Block", reinterpret_cast<int *>(&volume_render_options.skipping_type), static_cast<int>(VolumeRenderSubpass::SkippingType::Block));
 		    ImGui::SameLine();
+		    changed |= ImGui::RadioButton("Block (DDA)", reinterpret_cast<int *>(&volume_render_options.skipping_type), static_cast<int>(VolumeRenderSubpass::SkippingType::BlockDDA));
+		    ImGui::SameLine();
 		    changed |= ImGui::RadioButton("None##skipping", reinterpret_cast<int *>(&volume_render_options.skipping_type), static_cast<int>(VolumeRenderSubpass::SkippingType::None));
 		    gap();
 
+		    if (ImGui::Checkbox("Proxy", &volume_render_options.proxy_geometry))
+		    {
+			    compute_distance_map->set_proxy_geometry(volume_render_options.proxy_geometry);
+			    changed = true;
+		    }
+		    ImGui::SameLine();
+		    if (ImGui::Checkbox("Apron", &volume_render_options.apron_occupancy))
+		    {
+			    compute_distance_map->set_apron(volume_render_options.apron_occupancy);
+			    if (volume_render_options.apron_occupancy)
+			    {
+				    for (auto volume : volumes)
+				    {
+					    update_block_statistics(*volume, true, get_derived_data_key(*volume));
+				    }
+			    }
+			    changed = true;
+		    }
+		    gap();
+
 		    if (changed)
 		    {
 			    for (auto volume : volumes)
@@ -543,7 +1083,7 @@ void VolumeRender::draw_gui()
 			    init_render_pipeline();
 		    }
 	    },
-	    /* lines = */ static_cast<uint32_t>(2 + 2 * volumes.size()));
+	    /* lines = */ static_cast<uint32_t>(2 + 2 * volumes.size() + (volume_loader->get_pending_count() > 0 ? 1 : 0)));
 }
 
 std::unique_ptr<vkb::VulkanSample> create_volume_render()
@@ -21,13 +21,19 @@
 
 #include "scene_graph/components/camera.h"
 
+#include "compute_block_statistics.h"
 #include "compute_distance_map.h"
+#include "derived_data_cache.h"
 #include "compute_gradient_map.h"
+#include "compute_histogram.h"
 #include "compute_occupied_voxel_count.h"
+#include "volume_loader.h"
 #include "volume_render_subpass.h"
 
 #include "platform/plugins/plugin_base.h"
 
+#include <unordered_map>
+
 class VolumeRenderPlugin;
 
 using VolumeRenderPluginTags = vkb::PluginBase<VolumeRenderPlugin, vkb::tags::Passive>;
@@ -47,19 +53,45 @@ class VolumeRenderPlugin : public VolumeRenderPluginTags
 	vkb::FlagCommand imax_flag{vkb::FlagType::OneValue, "imax", "", "Intensity maximum"};
 	vkb::FlagCommand gmin_flag{vkb::FlagType::OneValue, "gmin", "", "Gradient minimum"};
 	vkb::FlagCommand gmax_flag{vkb::FlagType::OneValue, "gmax", "", "Gradient maximum"};
-	vkb::FlagCommand skipmode_flag{vkb::FlagType::OneValue, "skipmode", "", "Skipping mode 0=None, 1=Block 2=Distance 3=DistanceAnisotropic"};
+	vkb::FlagCommand skipmode_flag{vkb::FlagType::OneValue, "skipmode", "", "Skipping mode 0=None, 1=Block 2=Distance 3=DistanceAnisotropic 4=DistanceHierarchical 5=BlockDDA"};
+	vkb::FlagCommand occupancy_flag{vkb::FlagType::OneValue, "occupancy", "", "Occupancy map method 0=Voxels 1=BlockStatistics 2=VoxelsCooperative 3=Fused"};
+	vkb::FlagCommand distkernel_flag{vkb::FlagType::OneValue, "distkernel", "", "Distance map kernel 0=ZigZag 1=Linear"};
+	vkb::FlagCommand unbatched_flag{vkb::FlagType::FlagOnly, "unbatched", "", "Dispatch the anisotropic distance map stages per direction even where they can be batched"};
+	vkb::FlagCommand packed_flag{vkb::FlagType::FlagOnly, "packed", "", "Ray cast packed maps, 4-bit distances and 1-bit block occupancy"};
+	vkb::FlagCommand proxy_flag{vkb::FlagType::FlagOnly, "proxy", "", "Rasterise the boundary faces of occupied bricks rather than the volume's bounding box"};
+	vkb::FlagCommand apron_flag{vkb::FlagType::FlagOnly, "apron", "", "Evaluate occupancy over a one voxel apron so rays never step back on entering an occupied block"};
 	vkb::FlagCommand blocksize_flag{vkb::FlagType::OneValue, "blocksize", "", "Block size edge length"};
 	vkb::FlagCommand gradient_test_flag{vkb::FlagType::FlagOnly, "gradient_test", "", "Gradient test"};
+	vkb::FlagCommand validate_voxel_count_flag{vkb::FlagType::FlagOnly, "validate_voxel_count", "", "Validate the benchmark's occupied voxel count with a GPU sweep of the volume"};
+	vkb::FlagCommand validate_distance_map_flag{vkb::FlagType::FlagOnly, "validate_distance_map", "", "Validate the benchmark's distance maps against a CPU distance transform"};
+	vkb::FlagCommand reader_flag{vkb::FlagType::OneValue, "reader", "", "Volume reader 0=Stream 1=MemoryMapped 2=Direct"};
+	vkb::FlagCommand staging_flag{vkb::FlagType::OneValue, "staging", "", "Staging memory budget for volume upload (MB)"};
+	vkb::FlagCommand native16_flag{vkb::FlagType::FlagOnly, "native16", "", "Keep 16-bit volumes at full precision on the GPU"};
+	vkb::FlagCommand cache_flag{vkb::FlagType::FlagOnly, "cache", "", "Cache derived data (gradient map, histogram) next to the datasets"};
+	vkb::FlagCommand cachedir_flag{vkb::FlagType::OneValue, "cachedir", "", "Cache derived data in this directory"};
 	//vkb::FlagCommand datasets_flag{vkb::FlagType::ManyValues, "datasets", "D", "Dataset filesnames"};
 	vkb::PositionalCommand dataset_flag{"dataset", "Dataset filename"};
 
-	vkb::CommandGroup cmd{"Volume Render Options", {&imin_flag, &imax_flag, &gmin_flag, &gmax_flag, &skipmode_flag, &blocksize_flag, &gradient_test_flag, &dataset_flag}};
-
-	float                             imin, imax, gmin, gmax;
-	VolumeRenderSubpass::SkippingType skipmode;
-	int                               blocksize;
-	bool                              gradient_test;
-	std::vector<std::string>          datasets;
+	vkb::CommandGroup cmd{"Volume Render Options", {&imin_flag, &imax_flag, &gmin_flag, &gmax_flag, &skipmode_flag, &occupancy_flag, &distkernel_flag, &unbatched_flag, &packed_flag, &proxy_flag, &apron_flag, &blocksize_flag, &gradient_test_flag, &validate_voxel_count_flag, &validate_distance_map_flag, &reader_flag, &staging_flag, &native16_flag, &cache_flag, &cachedir_flag, &dataset_flag}};
+
+	float                               imin, imax, gmin, gmax;
+	VolumeRenderSubpass::SkippingType   skipmode;
+	ComputeDistanceMap::OccupancyMethod occupancy_method;
+	ComputeDistanceMap::DistanceKernel  distance_kernel;
+	bool                                unbatched;
+	bool                                packed;
+	bool                                proxy;
+	bool                                apron;
+	int                                 blocksize;
+	bool                                gradient_test;
+	bool                                validate_voxel_count;
+	bool                                validate_distance_map;
+	LoadVolume::ReaderType              reader_type;
+	size_t                              staging_budget;
+	bool                                native_16bit;
+	bool                                cache;
+	std::string                         cache_dir;
+	std::vector<std::string>            datasets;
 };
 
 class VolumeRender : public vkb::VulkanSample
@@ -80,6 +112,41 @@ class VolumeRender : public vkb::VulkanSample
 
 	void VolumeRender::update_transfer_function(Volume &volume);
 
+	// Counts the voxels with a non-zero alpha with a sweep over the whole volume on the GPU
+	uint64_t count_occupied_voxels(Volume &volume, vkb::BufferAllocation &transfer_function_uniform);
+
+	// Recomputes the precomputed gradient map, which depends on the window of native 16-bit volumes, or loads it from the derived data cache
+	void update_gradient_map(Volume &volume, uint64_t key);
+
+	// Rebuilds the per-block intensity and gradient ranges used to update occupancy maps, which depend on the window like the gradient map
+	// The ranges over blocks with an apron are only rebuilt while the apron is enabled, see ComputeDistanceMap::set_apron()
+	void update_block_statistics(Volume &volume, uint64_t key);
+	void update_block_statistics(Volume &volume, bool apron, uint64_t key);
+
+	// Rebuilds the joint intensity x gradient histogram of a volume, or loads it from the derived data cache
+	void update_histogram(Volume &volume, uint64_t key);
+
+	// Key of the derived data of a volume, covering the data file and every option the gradient map and histogram depend on
+	// The data file is only hashed the first time, compute the key once and pass it to the update functions above
+	// Returns 0 if caching is disabled or the data file cannot be read, nothing is loaded or stored with a zero key
+	uint64_t get_derived_data_key(Volume &volume);
+
+	// Uploads a cached image in the derived data cache, returns false if caching is disabled or there is no valid entry
+	bool load_cached_image(Volume &volume, const std::string &name, const Volume::Image &image, size_t texel_size, uint64_t key);
+
+	// Reads an image back and stores it in the derived data cache
+	void store_cached_image(Volume &volume, const std::string &name, const Volume::Image &image, size_t texel_size, uint64_t key);
+
+	// Reads an image in the shader read only layout back to the host
+	std::vector<uint8_t> read_back_image(const Volume::Image &image, size_t texel_size);
+
+	// Compares the distance maps of a volume against compute_distance_map_cpu() on the same occupancy map
+	void validate_distance_maps(Volume &volume, vkb::BufferAllocation &transfer_function_uniform);
+
+	// Adds volumes which have finished loading to the scene, returns true if any were added
+	bool add_loaded_volumes();
+	void add_volume(std::unique_ptr<Volume> volume);
+
 	vkb::CommandBuffer &compute_start();
 	void                compute_submit(vkb::CommandBuffer &command_buffer);
 
@@ -89,14 +156,25 @@ class VolumeRender : public vkb::VulkanSample
 
 	vkb::sg::Camera *camera;
 
+	std::unique_ptr<ComputeBlockStatistics>    compute_block_statistics;
 	std::unique_ptr<ComputeDistanceMap>        compute_distance_map;
 	std::unique_ptr<ComputeGradientMap>        compute_gradient_map;
+	std::unique_ptr<ComputeHistogram>          compute_histogram;
 	std::unique_ptr<ComputeOccupiedVoxelCount> compute_occupied_voxel_count;
+	std::unique_ptr<VolumeLoader>              volume_loader;
+
+	// Null when caching is disabled
+	std::unique_ptr<DerivedDataCache> derived_data_cache;
+
+	// DerivedDataCache::get_file_key() of each data file
+	std::unordered_map<std::string, uint64_t> derived_data_file_keys;
 
 	// Options
 	VolumeRenderSubpass::Options volume_render_options;
 	bool                         render_sponza_scene;
 	bool                         spin_volumes;
+	bool                         validate_occupied_voxel_count;
+	bool                         validate_distance_map;
 };
 
 std::unique_ptr<vkb::VulkanSample> create_volume_render();
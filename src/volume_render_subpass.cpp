@@ -49,15 +49,20 @@ VolumeRenderSubpass::VolumeRenderSubpass(RenderContext &render_context, sg::Scen
             {"volume_render_clipped.vert"},
             {"volume_render.frag"}},
     vertex_source_plane_intersection("volume_render_plane_intersection.vert"),
+    vertex_source_proxy("volume_render_proxy.vert"),
     camera{cam},
     volumes{scene.get_components<Volume>()},
     options(options)
 {
 	// FIXME: use_precomputed_gradients is set per volume... but should be a global option
-	if (volumes.front()->options.use_precomputed_gradient)
+	if (!volumes.empty() && volumes.front()->options.use_precomputed_gradient)
 	{
 		shader_variant.add_define("PRECOMPUTED_GRADIENT");
 	}
+	if (!volumes.empty())
+	{
+		volumes.front()->add_shader_defines(shader_variant);
+	}
 	if (options.skipping_type == SkippingType::AnisotropicDistance)
 	{
 		shader_variant.add_define("ANISOTROPIC_DISTANCE");
@@ -66,10 +71,31 @@ VolumeRenderSubpass::VolumeRenderSubpass(RenderContext &render_context, sg::Scen
 	{
 		shader_variant.add_define("BLOCK_SKIP");
 	}
+	else if (options.skipping_type == SkippingType::HierarchicalDistance)
+	{
+		shader_variant.add_define("HIERARCHICAL_DISTANCE_LEVELS " + std::to_string(Volume::distance_map_levels));
+	}
+	else if (options.skipping_type == SkippingType::BlockDDA)
+	{
+		shader_variant.add_define("BLOCK_DDA");
+	}
 	else if (options.skipping_type == SkippingType::None)
 	{
 		shader_variant.add_define("DISABLE_SKIP");
 	}
+	if (options.packed_distance_maps && options.skipping_type != SkippingType::None && options.skipping_type != SkippingType::HierarchicalDistance)
+	{
+		bool block = options.skipping_type == SkippingType::Block || options.skipping_type == SkippingType::BlockDDA;
+		shader_variant.add_define(block ? "PACKED_DISTANCE_MAP_BITS 1" : "PACKED_DISTANCE_MAP_BITS 4");
+	}
+	if (options.proxy_geometry)
+	{
+		shader_variant.add_define("PROXY_GEOMETRY");
+	}
+	if (options.apron_occupancy)
+	{
+		shader_variant.add_define("APRON_OCCUPANCY");
+	}
 	if (!options.early_ray_termination)
 	{
 		shader_variant.add_define("DISABLE_EARLY_RAY_TERMINATION");
@@ -98,6 +124,10 @@ void VolumeRenderSubpass::prepare()
 	auto &resource_cache = render_context.get_device().get_resource_cache();
 	resource_cache.request_shader_module(VK_SHADER_STAGE_VERTEX_BIT, get_vertex_shader(), shader_variant);
 	resource_cache.request_shader_module(VK_SHADER_STAGE_VERTEX_BIT, vertex_source_plane_intersection, shader_variant);
+	if (options.proxy_geometry)
+	{
+		resource_cache.request_shader_module(VK_SHADER_STAGE_VERTEX_BIT, vertex_source_proxy, shader_variant);
+	}
 	resource_cache.request_shader_module(VK_SHADER_STAGE_FRAGMENT_BIT, get_fragment_shader(), shader_variant);
 
 	auto &device = render_context.get_device();
@@ -144,6 +174,16 @@ void VolumeRenderSubpass::prepare()
 		transient_buffers.push_back(stage_buffer(command_buffer, indices, *index_buffer_plane_intersection));
 	}
 
+	{
+		// Two triangles per face of the proxy geometry, see volume_render_proxy.vert
+		std::vector<uint32_t> indices = {0, 1, 2, 3, 4, 5};
+		index_buffer_proxy            = std::make_unique<core::Buffer>(device,
+                                                      indices.size() * sizeof(uint32_t),
+                                                      VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                                                      VMA_MEMORY_USAGE_GPU_ONLY);
+		transient_buffers.push_back(stage_buffer(command_buffer, indices, *index_buffer_proxy));
+	}
+
 	command_buffer.end();
 
 	auto &queue = device.get_queue_by_flags(VK_QUEUE_GRAPHICS_BIT, 0);
@@ -162,7 +202,7 @@ void VolumeRenderSubpass::draw(CommandBuffer &command_buffer)
 
 	// Get shaders from cache
 	auto &resource_cache                        = command_buffer.get_device().get_resource_cache();
-	auto &vert_shader_module                    = resource_cache.request_shader_module(VK_SHADER_STAGE_VERTEX_BIT, get_vertex_shader(), shader_variant);
+	auto &vert_shader_module                    = resource_cache.request_shader_module(VK_SHADER_STAGE_VERTEX_BIT, options.proxy_geometry ? vertex_source_proxy : get_vertex_shader(), shader_variant);        // the proxy geometry replaces the cube
 	auto &vert_shader_module_plane_intersection = resource_cache.request_shader_module(VK_SHADER_STAGE_VERTEX_BIT, vertex_source_plane_intersection, shader_variant);
 	auto &frag_shader_module                    = resource_cache.request_shader_module(VK_SHADER_STAGE_FRAGMENT_BIT, get_fragment_shader(), shader_variant);
 
@@ -218,6 +258,12 @@ void VolumeRenderSubpass::draw(CommandBuffer &command_buffer)
 
 	for (auto volume : volumes)
 	{
+		// Every block is empty
+		if (glm::any(glm::lessThan(volume->get_occupied_block_max(), volume->get_occupied_block_min())))
+		{
+			continue;
+		}
+
 		TransferFunctionUniform transfer_function_uniform = volume->get_transfer_function_uniform();
 
 		CameraUniform camera_uniform;
@@ -241,12 +287,20 @@ void VolumeRenderSubpass::draw(CommandBuffer &command_buffer)
 		                               (ray_cast_uniform.plane_tex.y < 0 ? 2 : 0) +
 		                               (ray_cast_uniform.plane_tex.z < 0 ? 4 : 0);
 		auto volume_extent          = volume->get_volume().image->get_extent();
-		auto map_extent             = volume->get_distance_map().image->get_extent();
+		auto map_extent             = volume->get_distance_map_swap().image->get_extent();
 		ray_cast_uniform.block_size = glm::vec4(
 		    rndUp(volume_extent.width, map_extent.width),
 		    rndUp(volume_extent.height, map_extent.height),
 		    rndUp(volume_extent.depth, map_extent.depth),
 		    0);
+		glm::vec4 volume_dim(volume_extent.width, volume_extent.height, volume_extent.depth, 1);
+		ray_cast_uniform.proxy_brick_size = ray_cast_uniform.block_size * static_cast<float>(volume->get_proxy_brick_blocks()) / volume_dim;
+
+		// Widen the occupied blocks by a voxel as sample positions just outside of occupied blocks may have some opacity (due to linear sampling of the volume)
+		glm::vec4 occupied_block_min(glm::vec3(volume->get_occupied_block_min()), 0);
+		glm::vec4 occupied_block_max(glm::vec3(volume->get_occupied_block_max()), 0);
+		ray_cast_uniform.aabb_min_tex = glm::clamp((occupied_block_min * ray_cast_uniform.block_size - 1.0f) / volume_dim, 0.0f, 1.0f);
+		ray_cast_uniform.aabb_max_tex = glm::clamp(((occupied_block_max + 1.0f) * ray_cast_uniform.block_size + 1.0f) / volume_dim, 0.0f, 1.0f);
 		//options.resume_factor * transfer_function_uniform.sampling_factor *
 		//std::min(std::min(ray_cast_uniform.block_size.x, ray_cast_uniform.block_size.y), ray_cast_uniform.block_size.z);
 
@@ -259,7 +313,7 @@ void VolumeRenderSubpass::draw(CommandBuffer &command_buffer)
 		auto allocation_ray_cast = render_frame.allocate_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, sizeof(ray_cast_uniform));
 		allocation_ray_cast.update(ray_cast_uniform);
 
-		// Draw clipped cuboid
+		// Draw clipped cuboid, or the clipped occupied bricks
 		command_buffer.bind_pipeline_layout(pipeline_layout);
 		command_buffer.bind_buffer(allocation_camera.get_buffer(), allocation_camera.get_offset(), allocation_camera.get_size(), 0, 1, 0);
 		command_buffer.bind_buffer(allocation_ray_cast.get_buffer(), allocation_ray_cast.get_offset(), allocation_ray_cast.get_size(), 0, 2, 0);
@@ -270,21 +324,44 @@ void VolumeRenderSubpass::draw(CommandBuffer &command_buffer)
 		{
 			command_buffer.bind_image(*volume->get_gradient().image_view, *volume->get_gradient().sampler, 0, 6, 0);
 		}
+		bool packed           = options.packed_distance_maps && options.skipping_type != SkippingType::None && options.skipping_type != SkippingType::HierarchicalDistance;
+		auto get_distance_map = [&](size_t idx) -> const Volume::Image & {
+			return packed ? volume->get_packed_distance_map(idx) : volume->get_distance_map(idx);
+		};
 		if (options.skipping_type == SkippingType::AnisotropicDistance)
 		{
 			for (int i = 0; i < 8; ++i)
 			{
-				auto &distance_map = volume->get_distance_map(i);
+				auto &distance_map = get_distance_map(i);
 				command_buffer.bind_image(*distance_map.image_view, *distance_map.sampler, 0, 7, i);
 			}
 		}
+		else if (options.skipping_type == SkippingType::HierarchicalDistance)
+		{
+			for (uint32_t level = 0; level < Volume::distance_map_levels; ++level)
+			{
+				auto &distance_map = volume->get_distance_map_level(level);
+				command_buffer.bind_image(*distance_map.image_view, *distance_map.sampler, 0, 7, level);
+			}
+		}
 		else
 		{
-			command_buffer.bind_image(*volume->get_distance_map().image_view, *volume->get_distance_map().sampler, 0, 7, 0);
+			command_buffer.bind_image(*get_distance_map(0).image_view, *get_distance_map(0).sampler, 0, 7, 0);
 		}
 		command_buffer.bind_vertex_buffers(0, {*vertex_buffer}, {0});
-		command_buffer.bind_index_buffer(*index_buffer, 0, VkIndexType::VK_INDEX_TYPE_UINT32);
-		command_buffer.draw_indexed(index_count, 1, 0, 0, 0);
+		if (options.proxy_geometry)
+		{
+			// One instance per face
+			command_buffer.bind_buffer(volume->get_proxy_faces(), 0, volume->get_proxy_faces().get_size(), 0, 8, 0);
+			command_buffer.bind_image(*volume->get_proxy_bricks().image_view, *volume->get_proxy_bricks().sampler, 0, 9, 0);
+			command_buffer.bind_index_buffer(*index_buffer_proxy, 0, VkIndexType::VK_INDEX_TYPE_UINT32);
+			command_buffer.draw_indexed_indirect(volume->get_proxy_draw(), 0, 1, sizeof(VkDrawIndexedIndirectCommand));
+		}
+		else
+		{
+			command_buffer.bind_index_buffer(*index_buffer, 0, VkIndexType::VK_INDEX_TYPE_UINT32);
+			command_buffer.draw_indexed(index_count, 1, 0, 0, 0);
+		}
 
 		// Draw box plane intersection
 		command_buffer.bind_pipeline_layout(pipeline_layout_plane_intersection);
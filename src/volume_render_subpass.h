@@ -45,11 +45,14 @@ struct CameraUniform
 //*/
 struct RayCastUniform
 {
-	glm::vec4 plane;                 // clipping plane in global coordinates
-	glm::vec4 plane_tex;             // clipping plane in texture coordinates
-	glm::vec4 camera_pos_tex;        // camera position in texture coordinates
-	glm::vec4 block_size;            // block size of occupancy/distance map
-	int       front_index;           // index of the front vertex on the cube (see volume_render_plane_intersection.vert)
+	glm::vec4 plane;                   // clipping plane in global coordinates
+	glm::vec4 plane_tex;               // clipping plane in texture coordinates
+	glm::vec4 camera_pos_tex;          // camera position in texture coordinates
+	glm::vec4 block_size;              // block size of occupancy/distance map
+	glm::vec4 proxy_brick_size;        // brick size of the proxy geometry in texture coordinates (see volume_render_proxy.vert)
+	glm::vec4 aabb_min_tex;            // bounding box of the occupied blocks in texture coordinates, rays are cast within it
+	glm::vec4 aabb_max_tex;
+	int       front_index;             // index of the front vertex on the cube (see volume_render_plane_intersection.vert)
 };
 
 class VolumeRenderSubpass : public vkb::Subpass
@@ -57,10 +60,12 @@ class VolumeRenderSubpass : public vkb::Subpass
   public:
 	enum class SkippingType : int
 	{
-		None                = 0,
-		Block               = 1,
-		Distance            = 2,
-		AnisotropicDistance = 3
+		None                 = 0,
+		Block                = 1,
+		Distance             = 2,
+		AnisotropicDistance  = 3,
+		HierarchicalDistance = 4,        // distance maps at Volume::distance_map_levels block sizes, skips from the coarsest empty level
+		BlockDDA             = 5         // occupancy map traversed with a 3D DDA, each block the ray crosses is queried once
 	};
 
 	enum class Test : int
@@ -78,6 +83,9 @@ class VolumeRenderSubpass : public vkb::Subpass
 		bool         early_ray_termination = true;
 		bool         depth_attachment      = false;
 		Test         test                  = Test::None;
+		bool         packed_distance_maps  = false;        // sample the maps packed by ComputeDistanceMap::set_packed()
+		bool         proxy_geometry        = false;        // rasterise the occupied bricks extracted by ComputeDistanceMap::set_proxy_geometry() instead of the cube
+		bool         apron_occupancy       = false;        // the maps are computed with ComputeDistanceMap::set_apron(), rays need not step back on entering occupied blocks
 	};
 
 	VolumeRenderSubpass(vkb::RenderContext &render_context, vkb::sg::Scene &scene, vkb::sg::Camera &camera, Options options);
@@ -89,10 +97,11 @@ class VolumeRenderSubpass : public vkb::Subpass
 
   private:
 	vkb::ShaderSource     vertex_source_plane_intersection;
+	vkb::ShaderSource     vertex_source_proxy;
 	vkb::sg::Camera &     camera;
 	std::vector<Volume *> volumes;
 
-	std::unique_ptr<vkb::core::Buffer> vertex_buffer, index_buffer, index_buffer_plane_intersection;
+	std::unique_ptr<vkb::core::Buffer> vertex_buffer, index_buffer, index_buffer_plane_intersection, index_buffer_proxy;
 	uint32_t                           index_count, index_count_plane_intersection;
 
 	// Options
@@ -0,0 +1,135 @@
+/* Copyright (c) 2019, Lachlan Deakin
+*
+* SPDX-License-Identifier: Apache-2.0
+*
+* Licensed under the Apache License, Version 2.0 the "License";
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// Checks compute_distance_map_cpu() and compute_distance_map_anisotropic_cpu() against a brute force Chebyshev distance transform on small random occupancy maps,
+// and on scanlines longer than the 255 block cap
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "distance_map_cpu.h"
+
+namespace
+{
+const uint8_t OCCUPIED = 0;
+const uint8_t EMPTY    = 255;
+
+// Chebyshev distance to the nearest occupied block, capped at 255
+// Each axis only searches towards its sign where direction is non-zero, matching the octants of the anisotropic maps
+std::vector<uint8_t> brute_force(const std::vector<uint8_t> &occupancy_map, VkExtent3D extent, const std::array<int, 3> &direction)
+{
+	int                  w = extent.width, h = extent.height, d = extent.depth;
+	std::vector<uint8_t> distance_map(occupancy_map.size());
+	for (int z = 0; z < d; ++z)
+		for (int y = 0; y < h; ++y)
+			for (int x = 0; x < w; ++x)
+			{
+				int distance = EMPTY;
+				for (int qz = 0; qz < d; ++qz)
+					for (int qy = 0; qy < h; ++qy)
+						for (int qx = 0; qx < w; ++qx)
+						{
+							std::array<int, 3> delta = {qx - x, qy - y, qz - z};
+							bool               in_octant = true;
+							for (int a = 0; a < 3; ++a)
+							{
+								in_octant &= direction[a] * delta[a] >= 0;
+							}
+							if (in_octant && occupancy_map[(static_cast<size_t>(qz) * h + qy) * w + qx] == OCCUPIED)
+							{
+								distance = std::min(distance, std::max(std::max(std::abs(delta[0]), std::abs(delta[1])), std::abs(delta[2])));
+							}
+						}
+				distance_map[(static_cast<size_t>(z) * h + y) * w + x] = static_cast<uint8_t>(distance);
+			}
+	return distance_map;
+}
+
+bool check(const std::vector<uint8_t> &result, const std::vector<uint8_t> &expected, const char *name, VkExtent3D extent, float density)
+{
+	size_t n_mismatches = 0;
+	for (size_t i = 0; i < result.size(); ++i)
+	{
+		n_mismatches += result[i] != expected[i];
+	}
+	if (n_mismatches > 0)
+	{
+		std::cerr << name << ": " << n_mismatches << " of " << result.size() << " blocks differ from the brute force transform ("
+		          << extent.width << "x" << extent.height << "x" << extent.depth << ", density " << density << ")" << std::endl;
+	}
+	return n_mismatches == 0;
+}
+
+// Both CPU transforms against the brute force transform
+bool check_transforms(const std::vector<uint8_t> &occupancy_map, VkExtent3D extent, float density)
+{
+	std::vector<uint8_t> distance_map(occupancy_map.size());
+	compute_distance_map_cpu(occupancy_map.data(), extent, distance_map.data());
+	bool valid = check(distance_map, brute_force(occupancy_map, extent, {0, 0, 0}), "compute_distance_map_cpu", extent, density);
+
+	// Bits 2, 1 and 0 of the index select the -x, -y and -z octants
+	std::vector<std::vector<uint8_t>> distance_maps(8, std::vector<uint8_t>(occupancy_map.size()));
+	std::array<uint8_t *, 8>          outputs;
+	for (size_t i = 0; i < 8; ++i)
+	{
+		outputs[i] = distance_maps[i].data();
+	}
+	compute_distance_map_anisotropic_cpu(occupancy_map.data(), extent, outputs);
+	for (int i = 0; i < 8; ++i)
+	{
+		std::array<int, 3> direction = {i & 4 ? -1 : 1, i & 2 ? -1 : 1, i & 1 ? -1 : 1};
+		valid &= check(distance_maps[i], brute_force(occupancy_map, extent, direction), "compute_distance_map_anisotropic_cpu", extent, density);
+	}
+	return valid;
+}
+}        // namespace
+
+int main()
+{
+	std::mt19937 rng(1);
+	bool         valid = true;
+	for (int test = 0; test < 40; ++test)
+	{
+		// Odd extents and sparse maps exercise the scanline boundaries and distances longer than a scanline
+		std::uniform_int_distribution<uint32_t> extent_distribution(1, 13);
+		VkExtent3D                              extent  = {extent_distribution(rng), extent_distribution(rng), extent_distribution(rng)};
+		const float                             density = std::array<float, 4>{0.0f, 0.002f, 0.05f, 0.4f}[test % 4];
+		std::bernoulli_distribution             occupied(density);
+		std::vector<uint8_t>                    occupancy_map(static_cast<size_t>(extent.width) * extent.height * extent.depth);
+		for (auto &block : occupancy_map)
+		{
+			block = occupied(rng) ? OCCUPIED : EMPTY;
+		}
+
+		valid &= check_transforms(occupancy_map, extent, density);
+	}
+
+	// Distances saturate at 255 along scanlines longer than that, with a single occupied block at the start of the scanline
+	for (uint32_t axis = 0; axis < 3; ++axis)
+	{
+		VkExtent3D           extent = {axis == 0 ? 300u : 1u, axis == 1 ? 300u : 1u, axis == 2 ? 300u : 1u};
+		std::vector<uint8_t> occupancy_map(300, EMPTY);
+		occupancy_map[0] = OCCUPIED;
+		valid &= check_transforms(occupancy_map, extent, 1.0f / 300.0f);
+	}
+	return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+}